@@ -0,0 +1,65 @@
+#pragma once
+
+/* C interface of popVCF. Records are read without decoding their genotypes to text: each record has a table of unique
+ * genotype fields and the index of the field of each sample in that table.
+ *
+ * Pointers returned by the functions are owned by the reader. Unless noted otherwise, they are valid until the next
+ * call to popvcf_next or popvcf_close. A reader must not be used by several threads at the same time.
+ *
+ * Errors, such as unknown encoding options or missing files, are returned and described by popvcf_last_error. The
+ * process is only exited if htslib fails to open or close a file that popvcf_open has already checked. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POPVCF_ABI_VERSION 1
+
+typedef struct popvcf_reader popvcf_reader;
+
+//! Returns POPVCF_ABI_VERSION of the library.
+int popvcf_abi_version(void);
+
+//! Returns the message of the last error of the calling thread, or an empty string.
+char const * popvcf_last_error(void);
+
+//! Opens a popVCF, bgzipped or not, and reads its header. A \a region ("chrN", "chrN:A-B" or NULL for all records)
+//! requires a tabix index. Returns NULL on error.
+popvcf_reader * popvcf_open(char const * path, char const * region);
+
+//! Closes a reader. Does nothing if \a reader is NULL.
+void popvcf_close(popvcf_reader * reader);
+
+//! Decoded header lines, each ending with '\n'. Valid until popvcf_close.
+char const * popvcf_header(popvcf_reader const * reader, size_t * size);
+
+//! Number of samples of the "#CHROM" header line.
+size_t popvcf_n_samples(popvcf_reader const * reader);
+
+//! Name of sample \a sample_index. Valid until popvcf_close.
+char const * popvcf_sample_name(popvcf_reader const * reader, size_t sample_index);
+
+//! Reads the next record. Returns 1 if a record was read, 0 at the end (of the region) and -1 on error.
+int popvcf_next(popvcf_reader * reader);
+
+//! Site column \a column_index of the current record, where 0 is CHROM and 8 is FORMAT. Not null terminated.
+char const * popvcf_site_column(popvcf_reader const * reader, int column_index, size_t * size);
+
+//! POS of the current record.
+int64_t popvcf_pos(popvcf_reader const * reader);
+
+//! Number of unique genotype fields of the current record.
+size_t popvcf_n_unique_fields(popvcf_reader const * reader);
+
+//! Unique genotype field \a uid of the current record, null terminated.
+char const * popvcf_unique_field(popvcf_reader const * reader, size_t uid, size_t * size);
+
+//! Index of the unique genotype field of each sample in the current record, popvcf_n_samples entries.
+uint32_t const * popvcf_field2uid(popvcf_reader const * reader);
+
+#ifdef __cplusplus
+}
+#endif
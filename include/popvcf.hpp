@@ -1,5 +1,29 @@
 #pragma once
 
+#include "../src/add_samples.hpp"
+#include "../src/block_index.hpp"
+#include "../src/checkpoint.hpp"
+#include "../src/compare.hpp"
+#include "../src/concat.hpp"
 #include "../src/decode.hpp"
 #include "../src/encode.hpp"
+#include "../src/export.hpp"
+#include "../src/filter.hpp"
+#include "../src/format.hpp"
+#include "../src/gather_output.hpp"
+#include "../src/genotype.hpp"
+#include "../src/history.hpp"
+#include "../src/pipeline.hpp"
+#include "../src/reader.hpp"
+#include "../src/row_encoder.hpp"
 #include "../src/sequence_utils.hpp"
+#include "../src/serve.hpp"
+#include "../src/shadow_decoder.hpp"
+#include "../src/site_columns.hpp"
+#include "../src/split.hpp"
+#include "../src/spsc_queue.hpp"
+#include "../src/stats.hpp"
+#include "../src/thread_pool.hpp"
+#include "../src/verify.hpp"
+#include "../src/view.hpp"
+#include "../src/zone_map.hpp"
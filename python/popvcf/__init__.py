@@ -0,0 +1,223 @@
+"""Python bindings of popVCF.
+
+Records are read through the C interface of libpopvcf (include/popvcf.h). Genotypes are never formatted as VCF text,
+each record has a table of its unique genotype fields and the index of the field of each sample in that table. Arrays
+of all samples are filled by indexing a small per-record table with that index.
+
+    import popvcf
+
+    with popvcf.Reader("my.popvcf.gz", region="chr1:10000-20000") as reader:
+        for record in reader:
+            gt = record.genotypes()  # numpy.int8 array of shape (n_samples, ploidy)
+
+The library is loaded from the POPVCF_LIBRARY environment variable if it is set, otherwise from the system library
+path.
+"""
+
+import ctypes
+import ctypes.util
+import os
+
+import numpy as np
+
+__all__ = ["Reader", "Record", "PopvcfError"]
+
+ABI_VERSION = 1
+MISSING = -1  #: Allele of a missing genotype, e.g. "./."
+PADDING = -2  #: Allele that pads genotypes with a lower ploidy than the other samples
+
+
+class PopvcfError(Exception):
+    pass
+
+
+def _load_library():
+    path = os.environ.get("POPVCF_LIBRARY") or ctypes.util.find_library("popvcf")
+
+    if path is None:
+        raise ImportError("libpopvcf was not found, set POPVCF_LIBRARY to its path")
+
+    lib = ctypes.CDLL(path)
+    reader_p = ctypes.c_void_p
+    size_p = ctypes.POINTER(ctypes.c_size_t)
+    signatures = {
+        "popvcf_abi_version": (ctypes.c_int, []),
+        "popvcf_last_error": (ctypes.c_char_p, []),
+        "popvcf_open": (reader_p, [ctypes.c_char_p, ctypes.c_char_p]),
+        "popvcf_close": (None, [reader_p]),
+        "popvcf_header": (ctypes.c_void_p, [reader_p, size_p]),
+        "popvcf_n_samples": (ctypes.c_size_t, [reader_p]),
+        "popvcf_sample_name": (ctypes.c_char_p, [reader_p, ctypes.c_size_t]),
+        "popvcf_next": (ctypes.c_int, [reader_p]),
+        "popvcf_site_column": (ctypes.c_void_p, [reader_p, ctypes.c_int, size_p]),
+        "popvcf_pos": (ctypes.c_int64, [reader_p]),
+        "popvcf_n_unique_fields": (ctypes.c_size_t, [reader_p]),
+        "popvcf_unique_field": (ctypes.c_void_p, [reader_p, ctypes.c_size_t, size_p]),
+        "popvcf_field2uid": (ctypes.POINTER(ctypes.c_uint32), [reader_p]),
+    }
+
+    for name, (restype, argtypes) in signatures.items():
+        func = getattr(lib, name)
+        func.restype = restype
+        func.argtypes = argtypes
+
+    if lib.popvcf_abi_version() != ABI_VERSION:
+        version = lib.popvcf_abi_version()
+        raise ImportError("libpopvcf at %s has ABI version %d, expected %d" % (path, version, ABI_VERSION))
+
+    return lib
+
+
+_lib = _load_library()
+
+
+def _string(data, size):
+    return ctypes.string_at(data, size.value).decode() if size.value > 0 else ""
+
+
+def _parse_gt(field):
+    """Returns the alleles of the GT subfield of a genotype field, with MISSING for '.'."""
+    gt = field.split(":", 1)[0].replace("|", "/")
+    return [MISSING if allele == "." else int(allele) for allele in gt.split("/")]
+
+
+class Record:
+    """The current record of a Reader. Its data is only valid until the reader moves to the next record."""
+
+    def __init__(self, reader):
+        self._reader = reader
+
+    def _column(self, index):
+        size = ctypes.c_size_t()
+        data = _lib.popvcf_site_column(self._reader._handle, index, ctypes.byref(size))
+        return _string(data, size)
+
+    @property
+    def chrom(self):
+        return self._column(0)
+
+    @property
+    def pos(self):
+        return _lib.popvcf_pos(self._reader._handle)
+
+    @property
+    def id(self):
+        return self._column(2)
+
+    @property
+    def ref(self):
+        return self._column(3)
+
+    @property
+    def alt(self):
+        return self._column(4).split(",")
+
+    @property
+    def qual(self):
+        return self._column(5)
+
+    @property
+    def filter(self):
+        return self._column(6)
+
+    @property
+    def info(self):
+        return self._column(7)
+
+    @property
+    def format(self):
+        return self._column(8)
+
+    def unique_fields(self):
+        """Unique genotype fields of the record, in order of first appearance."""
+        handle = self._reader._handle
+        size = ctypes.c_size_t()
+        fields = []
+
+        for uid in range(_lib.popvcf_n_unique_fields(handle)):
+            data = _lib.popvcf_unique_field(handle, uid, ctypes.byref(size))
+            fields.append(_string(data, size))
+
+        return fields
+
+    def field2uid(self):
+        """Index in unique_fields() of the genotype field of each sample. The array is a view of the reader's memory,
+        copy it to keep it after the reader has moved on."""
+        n_samples = len(self._reader.samples)
+
+        if n_samples == 0:
+            return np.zeros(0, dtype=np.uint32)
+
+        return np.ctypeslib.as_array(_lib.popvcf_field2uid(self._reader._handle), shape=(n_samples,))
+
+    def map_unique(self, func, dtype):
+        """Applies func to each unique genotype field and returns the result of each sample as an array."""
+        table = np.array([func(field) for field in self.unique_fields()], dtype=dtype)
+        return table[self.field2uid()]
+
+    def genotypes(self, dtype=np.int8):
+        """Alleles of the GT of each sample, as an array of shape (n_samples, ploidy). Missing alleles are MISSING and
+        samples with a lower ploidy than others are padded with PADDING."""
+        alleles = [_parse_gt(field) for field in self.unique_fields()]
+        ploidy = max((len(a) for a in alleles), default=0)
+        table = np.full((len(alleles), ploidy), PADDING, dtype=dtype)
+
+        for uid, a in enumerate(alleles):
+            table[uid, : len(a)] = a
+
+        return table[self.field2uid()]
+
+    def alt_counts(self, dtype=np.int8):
+        """Number of non-reference alleles in the GT of each sample, or MISSING if any allele is missing."""
+
+        def count(field):
+            alleles = _parse_gt(field)
+            return MISSING if MISSING in alleles else sum(allele > 0 for allele in alleles)
+
+        return self.map_unique(count, dtype)
+
+
+class Reader:
+    """Reads the records of a popVCF, optionally in a region of a tabix indexed file."""
+
+    def __init__(self, path, region=None):
+        self._handle = _lib.popvcf_open(os.fsencode(path), region.encode() if region else None)
+
+        if not self._handle:
+            raise PopvcfError(_lib.popvcf_last_error().decode())
+
+        self.samples = [
+            _lib.popvcf_sample_name(self._handle, s).decode() for s in range(_lib.popvcf_n_samples(self._handle))
+        ]
+        self._record = Record(self)
+
+    @property
+    def header(self):
+        size = ctypes.c_size_t()
+        data = _lib.popvcf_header(self._handle, ctypes.byref(size))
+        return _string(data, size)
+
+    def __iter__(self):
+        while True:
+            ret = _lib.popvcf_next(self._handle)
+
+            if ret < 0:
+                raise PopvcfError(_lib.popvcf_last_error().decode())
+            elif ret == 0:
+                return
+
+            yield self._record
+
+    def close(self):
+        if self._handle:
+            _lib.popvcf_close(self._handle)
+            self._handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        self.close()
@@ -0,0 +1,373 @@
+#include "add_samples.hpp"
+
+#include <algorithm>   // std::count, std::find, std::max
+#include <cstdlib>     // std::exit, free
+#include <deque>       // std::deque
+#include <future>      // std::future
+#include <iostream>    // std::cerr
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+#include <parallel_hashmap/phmap.h> // phmap::flat_hash_set
+
+#include "decode.hpp"
+#include "encode.hpp"
+#include "format.hpp"
+#include "io.hpp"
+#include "sequence_utils.hpp" // get_vcf_pos, is_same_block, split_string
+#include "thread_pool.hpp"
+
+#include "htslib/bgzf.h"
+#include "htslib/kstring.h"
+
+namespace popvcf
+{
+namespace
+{
+std::size_t constexpr TASK_SIZE{4 * DEC_BUFFER_SIZE}; //!< Blocks are processed in tasks of about this many bytes
+
+//! Records of the blocks that one task adds samples to
+class AddSamplesTask
+{
+public:
+  std::vector<char> records{};           //!< Encoded records of the popVCF
+  std::vector<char> genotypes{};         //!< Genotype fields of the new samples of each record, ending with '\n'
+  std::vector<std::size_t> block_ends{}; //!< Number of records up to the end of each block
+  std::size_t n_records{0};              //!< Number of records
+};
+
+//! Returns the index where column \a column_index of a line begins, or npos if it has fewer columns.
+std::size_t find_column(std::string_view const line, long column_index)
+{
+  std::size_t b{0};
+
+  for (; column_index > 0 && b != std::string_view::npos; --column_index)
+  {
+    b = line.find('\t', b);
+    b = b == std::string_view::npos ? b : b + 1;
+  }
+
+  return b;
+}
+
+//! Returns true if the last encoded genotype field is '$' or '&', which are not followed by a tab.
+bool is_last_tab_elided(std::string_view const encoded)
+{
+  bool is_elided{false};
+  std::size_t b{0};
+
+  while (b < encoded.size())
+  {
+    is_elided = encoded[b] == '$' || encoded[b] == '&';
+
+    if (is_elided)
+    {
+      ++b;
+      continue;
+    }
+
+    b = encoded.find('\t', b);
+    b = b == std::string_view::npos ? b : b + 1;
+  }
+
+  return is_elided;
+}
+
+//! Returns the popVCF records of a task with the new genotype fields added.
+std::vector<char> add_samples_to_blocks(AddSamplesTask const & task, FormatOptions const & options)
+{
+  std::vector<char> out;
+  std::vector<char> line;    // record that is decoded or encoded
+  std::vector<char> decoded; // decoded record
+  std::size_t rb{0};         // begin of the current record
+  std::size_t gb{0};         // begin of the new genotype fields of the current record
+  std::size_t r{0};          // index of the current record
+
+  for (std::size_t const block_end : task.block_ends)
+  {
+    /// Each block is processed from scratch, records never refer to records of other blocks
+    DecodeData dd;
+    dd.options = options;
+    dd.write_genotypes = options.checksum || options.packed; // decoded genotypes are needed to encode them again
+    EncodeData ed;
+    ed.set_options(options);
+    ed.is_options_written = true;
+
+    for (; r < block_end; ++r)
+    {
+      std::size_t const re = std::find(task.records.begin() + rb, task.records.end(), '\n') - task.records.begin();
+      std::size_t const ge =
+        std::find(task.genotypes.begin() + gb, task.genotypes.end(), '\n') - task.genotypes.begin();
+      std::string_view const record(task.records.data() + rb, re - rb);
+      std::string_view const new_genotypes(task.genotypes.data() + gb, ge - gb + 1); // includes '\n'
+      rb = re + 1;
+      gb = ge + 1;
+
+      std::size_t const sites_end = find_column(record, 9);
+      std::size_t const genotypes_begin = options.has_record_prefix() ? record.find('\t', sites_end) + 1 : sites_end;
+      std::string_view const encoded = record.substr(genotypes_begin);
+
+      /// A packed record is encoded again, and its site columns against the same previous record as in the popVCF
+      if (options.site_columns && encoded[0] == PACKED_ROW_MARKER)
+        ed.site_columns = dd.site_columns;
+
+      /// Decode the record to get its unique fields
+      line.assign(record.begin(), record.end());
+      line.push_back('\n');
+      decoded.resize(0);
+      decode_buffer</*is_region=*/false>(decoded, line, dd);
+
+      if (encoded[0] == PACKED_ROW_MARKER)
+      {
+        /// Packed records are encoded again since the packed genotypes cannot be extended
+        line.assign(decoded.begin(), decoded.end() - 1);
+        line.push_back('\t');
+        line.insert(line.end(), new_genotypes.begin(), new_genotypes.end());
+        encode_buffer(out, line, ed);
+        continue;
+      }
+
+      /// Start the record in the encoder the same way encode_buffer does at the ALT field
+      std::size_t const alt_begin = find_column(record, 4);
+      std::string_view const alt = record.substr(alt_begin, record.find('\t', alt_begin) - alt_begin);
+      ed.next_contig.assign(record.substr(0, record.find('\t')));
+      ed.clear_line(get_vcf_pos(record.begin(), record.end()), std::count(alt.begin(), alt.end(), ','));
+      ed.unique_fields = dd.unique_fields;
+      ed.field2uid = dd.field2uid;
+      ed.map_to_unique_fields = dd.map_to_unique_fields;
+
+      /// Keep the site columns and the encoded genotypes
+      out.insert(out.end(), record.begin(), record.begin() + sites_end);
+      ed.frame_begin = out.size();
+      out.insert(out.end(), encoded.begin(), encoded.end());
+
+      if (!is_last_tab_elided(encoded))
+        out.push_back('\t');
+
+      /// Encode the new genotype fields as the continuation of the record, its prefix is written below
+      line.assign(new_genotypes.begin(), new_genotypes.end());
+      ed.options = FormatOptions();
+      ed.header_line = false;
+      ed.field = 9 + dd.field2uid.size();
+      encode_buffer(out, line, ed);
+      ed.options = options;
+
+      if (options.checksum)
+      {
+        update_checksum(ed, decoded.data(), decoded.size() - 1);
+        update_checksum(ed, "\t", 1);
+        update_checksum(ed, new_genotypes.data(), new_genotypes.size());
+        close_checksum(ed);
+      }
+
+      if (options.has_record_prefix())
+        close_frame(out, ed);
+    }
+  }
+
+  return out;
+}
+
+[[noreturn]] void add_samples_error(std::string const & message)
+{
+  std::cerr << "[popvcf] ERROR: " << message << std::endl;
+  std::exit(1);
+}
+
+} // namespace
+
+void add_samples(std::string const & popvcf_fn,
+                 std::string const & vcf_fn,
+                 std::string const & output_fn,
+                 bool const is_bgzf_output,
+                 int const threads)
+{
+  /// Input and output streams, bgzf also reads files that are not compressed
+  popvcf::bgzf_ptr in_popvcf = popvcf::open_bgzf(popvcf_fn, "r");
+  popvcf::bgzf_ptr in_vcf = popvcf::open_bgzf(vcf_fn, "r");
+  popvcf::bgzf_ptr out_bgzf(nullptr, popvcf::close_bgzf);
+  popvcf::file_ptr out_vcf(nullptr, popvcf::close_vcf_nop);
+
+  if (is_bgzf_output)
+  {
+    out_bgzf = popvcf::open_bgzf(output_fn, "w");
+
+    if (threads > 1)
+      bgzf_mt(out_bgzf.get(), threads, 256);
+  }
+  else
+  {
+    out_vcf = popvcf::open_vcf(output_fn, "w");
+  }
+
+  /// Read the samples of the VCF
+  kstring_t str = {0, 0, nullptr};     // line of the popVCF
+  kstring_t vcf_str = {0, 0, nullptr}; // line of the VCF
+  std::string new_samples;             // new samples, each preceded by '\t'
+  phmap::flat_hash_set<std::string> new_sample_names;
+  bool is_vcf_pending{false}; // true iff vcf_str has the first record of the VCF
+
+  while (bgzf_getline(in_vcf.get(), '\n', &vcf_str) >= 0)
+  {
+    std::string_view const line(vcf_str.s, vcf_str.l);
+
+    if (line.empty() || line[0] != '#')
+    {
+      is_vcf_pending = true;
+      break;
+    }
+
+    std::size_t const genotypes_begin = find_column(line, 9);
+
+    if (line.substr(0, 6) == "#CHROM" && genotypes_begin != std::string_view::npos)
+    {
+      new_samples.assign(line.substr(genotypes_begin - 1));
+
+      for (std::string_view const sample : split_string(line.substr(genotypes_begin), '\t'))
+        new_sample_names.emplace(sample);
+    }
+  }
+
+  if (new_samples.empty())
+    add_samples_error("No samples on the #CHROM line of " + vcf_fn);
+
+  /// Copy the header of the popVCF and add the new samples
+  FormatOptions options;
+  std::string header;
+  bool has_record{false};
+
+  while (bgzf_getline(in_popvcf.get(), '\n', &str) >= 0)
+  {
+    std::string_view const line(str.s, str.l);
+
+    if (line.empty() || line[0] != '#')
+    {
+      has_record = !line.empty();
+      break;
+    }
+
+    options.parse_header_line(line);
+    header.append(line);
+
+    if (line.substr(0, 6) == "#CHROM")
+    {
+      if (find_column(line, 9) == std::string_view::npos)
+        add_samples_error("No samples on the #CHROM line of " + popvcf_fn);
+
+      for (std::string_view const sample : split_string(line.substr(find_column(line, 9)), '\t'))
+      {
+        if (new_sample_names.count(std::string(sample)) > 0)
+          add_samples_error("Sample " + std::string(sample) + " of " + vcf_fn + " is already in " + popvcf_fn);
+      }
+
+      header.append(new_samples);
+    }
+
+    header.push_back('\n');
+  }
+
+  popvcf::write_output(out_bgzf.get(), out_vcf.get(), header.data(), header.size());
+
+  /// Add the samples to blocks in parallel, the output is written in the order of the blocks
+  ThreadPool pool(std::max(1, threads));
+  std::deque<std::future<std::vector<char>>> results;
+  std::size_t const max_pending_tasks = 4 * std::max(1, threads);
+  AddSamplesTask task;
+  std::string block_contig; // empty before the first record
+  long block_pos{0};         // POS of the first record of the block
+  SiteColumns site_columns; // decoded site columns of the previous record
+
+  auto collect_result = [&]()
+  {
+    std::vector<char> const out = results.front().get();
+    results.pop_front();
+    popvcf::write_output(out_bgzf.get(), out_vcf.get(), out.data(), out.size());
+  };
+
+  auto submit_task = [&]()
+  {
+    if (task.n_records == 0)
+      return;
+
+    task.block_ends.push_back(task.n_records);
+    results.push_back(pool.submit([t = std::move(task), &options]() { return add_samples_to_blocks(t, options); }));
+    task = AddSamplesTask();
+
+    if (results.size() >= max_pending_tasks)
+      collect_result();
+  };
+
+  while (has_record)
+  {
+    std::string_view const record(str.s, str.l);
+    std::size_t const sites_end = find_column(record, 9);
+
+    if (sites_end == std::string_view::npos)
+      add_samples_error("Record without genotypes in " + popvcf_fn);
+
+    /// The record of the VCF must have the same site
+    bool const has_vcf_record = (is_vcf_pending || bgzf_getline(in_vcf.get(), '\n', &vcf_str) >= 0) && vcf_str.l > 0;
+    is_vcf_pending = false;
+    std::string_view const vcf_record(vcf_str.s, has_vcf_record ? vcf_str.l : 0);
+    std::size_t const vcf_genotypes_begin = find_column(vcf_record, 9);
+    std::vector<std::string_view> sites(9);
+
+    for (long c{0}; c < 9; ++c)
+    {
+      std::size_t const b = find_column(record, c);
+      sites[c] = record.substr(b, record.find('\t', b) - b);
+
+      if (options.site_columns && is_coded_site_column(c))
+        sites[c] = site_columns.decode(c, sites[c]); // the encoded column may refer to the previous record
+    }
+
+    if (!has_vcf_record || vcf_genotypes_begin == std::string_view::npos)
+      add_samples_error("No genotypes for the record at " + std::string(sites[0]) + ":" + std::string(sites[1]));
+
+    std::vector<std::string_view> const vcf_sites = split_string(vcf_record.substr(0, vcf_genotypes_begin - 1), '\t');
+
+    for (long const c : {0 /*CHROM*/, 1 /*POS*/, 3 /*REF*/, 4 /*ALT*/, 8 /*FORMAT*/})
+    {
+      if (sites[c] != vcf_sites[c])
+      {
+        add_samples_error("Record at " + std::string(vcf_sites[0]) + ":" + std::string(vcf_sites[1]) + " of " +
+                          vcf_fn + " does not have the same CHROM, POS, REF, ALT and FORMAT as in " + popvcf_fn);
+      }
+    }
+
+    /// Find where blocks begin, the same way the encoder does
+    long const pos = get_vcf_pos(record.begin(), record.end());
+
+    if (!is_same_block(sites[0], pos, block_contig, block_pos))
+    {
+      if (task.records.size() >= TASK_SIZE)
+        submit_task();
+      else if (task.n_records > 0)
+        task.block_ends.push_back(task.n_records);
+
+      block_contig.assign(sites[0]);
+      block_pos = pos;
+    }
+
+    task.records.insert(task.records.end(), record.begin(), record.end());
+    task.records.push_back('\n');
+    task.genotypes.insert(task.genotypes.end(), vcf_record.begin() + vcf_genotypes_begin, vcf_record.end());
+    task.genotypes.push_back('\n');
+    ++task.n_records;
+    has_record = bgzf_getline(in_popvcf.get(), '\n', &str) >= 0 && str.l > 0;
+  }
+
+  submit_task();
+
+  while (!results.empty())
+    collect_result();
+
+  if ((is_vcf_pending || bgzf_getline(in_vcf.get(), '\n', &vcf_str) >= 0) && vcf_str.l > 0)
+    add_samples_error(vcf_fn + " has more records than " + popvcf_fn);
+
+  free(str.s);
+  free(vcf_str.s);
+}
+
+} // namespace popvcf
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+namespace popvcf
+{
+//! Adds the samples of a VCF to a popVCF with the same records, without re-encoding the popVCF. The encoded genotypes
+//! of each record are kept and only the new genotype fields are encoded after them, continuing the unique fields of
+//! the record. Packed records are re-encoded. Blocks are processed by \a threads threads. CHROM, POS, REF, ALT and
+//! FORMAT of the records must be the same in both files.
+void add_samples(std::string const & popvcf_fn,
+                 std::string const & vcf_fn,
+                 std::string const & output_fn,
+                 bool const is_bgzf_output,
+                 int const threads);
+
+} // namespace popvcf
@@ -0,0 +1,333 @@
+#include "block_index.hpp"
+
+#include <algorithm>   // std::max, std::min
+#include <charconv>    // std::from_chars
+#include <cstdint>     // uint64_t
+#include <cstdlib>     // std::exit, free
+#include <cstring>     // std::memchr
+#include <deque>       // std::deque
+#include <fstream>     // std::ifstream, std::ofstream
+#include <future>      // std::future
+#include <iostream>    // std::cerr
+#include <iterator>    // std::make_move_iterator
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+#include <fcntl.h>  // open
+#include <unistd.h> // close, pread
+
+#include "io.hpp"
+#include "sequence_utils.hpp" // is_same_block, split_string
+#include "thread_pool.hpp"
+
+#include "htslib/bgzf.h"
+#include "htslib/hts.h"
+#include "htslib/kstring.h"
+
+namespace popvcf
+{
+namespace
+{
+std::size_t constexpr INDEX_BUFFER_SIZE{1 << 20}; //!< Bytes read at a time when scanning a plain popVCF
+uint64_t constexpr MIN_CHUNK_SIZE{16 << 20};       //!< Smallest part of a plain popVCF that is scanned by one task
+
+//! Blocks of the records in one part of a popVCF
+class IndexChunk
+{
+public:
+  std::vector<IndexedBlock> blocks{}; //!< The first block may continue the last block of the previous part
+  int64_t last_pos{0};                //!< POS of the last record
+};
+
+//! Adds the record that begins with \a line at \a offset, unless it is a header line. Only CHROM and POS are read.
+void add_record(IndexChunk & chunk, std::string_view const line, uint64_t const offset, std::string const & popvcf_fn)
+{
+  if (!line.empty() && line[0] == '#')
+    return;
+
+  std::size_t const tab = line.find('\t');
+  int64_t pos{0};
+
+  if (tab == std::string_view::npos ||
+      std::from_chars(line.data() + tab + 1, line.data() + line.size(), pos).ec != std::errc())
+  {
+    std::cerr << "[popvcf] ERROR: Invalid record in " << popvcf_fn << ": " << line.substr(0, 100) << std::endl;
+    std::exit(1);
+  }
+
+  std::string_view const contig = line.substr(0, tab);
+
+  /// Like the encoder, a block begins when the contig or the block of the position changes
+  if (chunk.blocks.empty() || !is_same_block(chunk.blocks.back().contig, chunk.last_pos, contig, pos))
+  {
+    IndexedBlock block;
+    block.contig = contig;
+    block.pos = pos;
+    block.offset = offset;
+    chunk.blocks.push_back(std::move(block));
+  }
+
+  ++chunk.blocks.back().n_records;
+  chunk.last_pos = pos;
+}
+
+//! Finds the blocks of the records that begin in [begin, end) of a plain popVCF, which is open as \a fd.
+IndexChunk scan_chunk(int const fd,
+                      std::string const & popvcf_fn,
+                      uint64_t const begin,
+                      uint64_t const end,
+                      uint64_t const file_size)
+{
+  IndexChunk chunk;
+  std::vector<char> buffer(INDEX_BUFFER_SIZE);
+  std::string head;            // CHROM and POS of the line that begins at line_begin
+  int n_head_tabs{0};          // tabs in head
+  bool is_in_head{begin == 0}; // true iff head is read, otherwise the rest of a line is skipped
+  uint64_t line_begin{0};      // offset of the line that is read
+
+  /// The first line of the chunk follows a newline at begin - 1 or later
+  uint64_t offset = begin == 0 ? 0 : begin - 1;
+
+  while (offset < file_size)
+  {
+    ssize_t const size = pread(fd, buffer.data(), std::min<uint64_t>(buffer.size(), file_size - offset), offset);
+
+    if (size <= 0)
+    {
+      std::cerr << "[popvcf] ERROR: Could not read " << popvcf_fn << " at offset " << offset << std::endl;
+      std::exit(1);
+    }
+
+    char const * p = buffer.data();
+    char const * const buffer_end = p + size;
+
+    while (p < buffer_end)
+    {
+      if (!is_in_head)
+      {
+        p = static_cast<char const *>(std::memchr(p, '\n', buffer_end - p));
+
+        if (p == nullptr)
+          break;
+
+        ++p;
+        line_begin = offset + (p - buffer.data());
+
+        if (line_begin >= end)
+          return chunk; // the line is in the next chunk
+
+        is_in_head = true;
+        head.clear();
+        n_head_tabs = 0;
+        continue;
+      }
+
+      /// CHROM and POS end at the second tab
+      char const * q = p;
+
+      while (q < buffer_end && *q != '\n' && !(*q == '\t' && ++n_head_tabs == 2))
+        ++q;
+
+      head.append(p, q);
+      p = q;
+
+      if (q < buffer_end)
+      {
+        add_record(chunk, head, line_begin, popvcf_fn);
+        is_in_head = false;
+      }
+    }
+
+    offset += size;
+  }
+
+  return chunk;
+}
+
+} // namespace
+
+void BlockIndex::write(std::string const & fn) const
+{
+  std::ofstream out(fn);
+
+  if (!out.is_open())
+  {
+    std::cerr << "[popvcf] ERROR: Could not open block index " << fn << " for writing." << std::endl;
+    std::exit(1);
+  }
+
+  out << "##popvcf_block_index=1\n"
+      << "##bgzf=" << is_bgzf << '\n'
+      << "##file_size=" << file_size << '\n'
+      << "##file_mtime=" << file_mtime << '\n'
+      << "#CHROM\tPOS\tOFFSET\tN_RECORDS\n";
+
+  for (IndexedBlock const & block : blocks)
+    out << block.contig << '\t' << block.pos << '\t' << block.offset << '\t' << block.n_records << '\n';
+}
+
+bool BlockIndex::read(std::string const & fn)
+{
+  std::ifstream in(fn);
+
+  if (!in.is_open())
+    return false;
+
+  blocks.clear();
+  std::string line;
+  std::string_view constexpr BGZF_PREFIX{"##bgzf="};
+  std::string_view constexpr FILE_SIZE_PREFIX{"##file_size="};
+  std::string_view constexpr FILE_MTIME_PREFIX{"##file_mtime="};
+
+  auto parse = [](std::string_view const column, auto & value)
+  {
+    auto ret = std::from_chars(column.data(), column.data() + column.size(), value);
+    return ret.ec == std::errc() && ret.ptr == column.data() + column.size();
+  };
+
+  while (std::getline(in, line))
+  {
+    std::string_view const line_view(line);
+    bool is_valid{true};
+
+    if (line_view.substr(0, BGZF_PREFIX.size()) == BGZF_PREFIX)
+    {
+      is_valid = line_view.substr(BGZF_PREFIX.size()) == "0" || line_view.substr(BGZF_PREFIX.size()) == "1";
+      is_bgzf = line_view.substr(BGZF_PREFIX.size()) == "1";
+    }
+    else if (line_view.substr(0, FILE_SIZE_PREFIX.size()) == FILE_SIZE_PREFIX)
+    {
+      is_valid = parse(line_view.substr(FILE_SIZE_PREFIX.size()), file_size);
+    }
+    else if (line_view.substr(0, FILE_MTIME_PREFIX.size()) == FILE_MTIME_PREFIX)
+    {
+      is_valid = parse(line_view.substr(FILE_MTIME_PREFIX.size()), file_mtime);
+    }
+    else if (!line.empty() && line[0] != '#')
+    {
+      std::vector<std::string_view> const columns = split_string(line, '\t');
+      IndexedBlock block;
+      is_valid = columns.size() == 4 && parse(columns[1], block.pos) && parse(columns[2], block.offset) &&
+                 parse(columns[3], block.n_records);
+
+      if (is_valid)
+      {
+        block.contig = columns[0];
+        blocks.push_back(std::move(block));
+      }
+    }
+
+    if (!is_valid)
+    {
+      std::cerr << "[popvcf] ERROR: Could not parse line of block index " << fn << ": " << line << std::endl;
+      std::exit(1);
+    }
+  }
+
+  return true;
+}
+
+void index_file(std::string const & popvcf_fn, int const threads)
+{
+  BlockIndex index;
+  index.file_size = get_file_size(popvcf_fn);
+  index.file_mtime = get_file_mtime(popvcf_fn);
+  std::vector<IndexChunk> chunks;
+
+  {
+    popvcf::bgzf_ptr in_bgzf = popvcf::open_bgzf(popvcf_fn, "r");
+    int const compression = bgzf_compression(in_bgzf.get());
+
+    if (compression != no_compression && compression != bgzf)
+    {
+      std::cerr << "[popvcf] ERROR: " << popvcf_fn << " is compressed but not bgzipped." << std::endl;
+      std::exit(1);
+    }
+
+    index.is_bgzf = compression == bgzf;
+
+    /// A bgzipped popVCF is decompressed in parallel and scanned in order, which needs no seeking within BGZF blocks
+    if (index.is_bgzf)
+    {
+      if (threads > 1)
+        bgzf_mt(in_bgzf.get(), threads, 256);
+
+      chunks.emplace_back();
+      kstring_t str{0, 0, nullptr};
+      uint64_t voffset = bgzf_tell(in_bgzf.get());
+
+      while (bgzf_getline(in_bgzf.get(), '\n', &str) >= 0)
+      {
+        add_record(chunks.back(), std::string_view(str.s, str.l), voffset, popvcf_fn);
+        voffset = bgzf_tell(in_bgzf.get());
+      }
+
+      free(str.s);
+    }
+  }
+
+  /// A plain popVCF is scanned in chunks in parallel, each chunk has the records that begin in it
+  if (!index.is_bgzf)
+  {
+    int const fd = open(popvcf_fn.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+      std::cerr << "[popvcf] ERROR: Could not open " << popvcf_fn << std::endl;
+      std::exit(1);
+    }
+
+    uint64_t const n_chunks =
+      std::max<uint64_t>(1, std::min<uint64_t>(4 * std::max(1, threads), index.file_size / MIN_CHUNK_SIZE));
+    ThreadPool pool(std::max(1, threads));
+    std::deque<std::future<IndexChunk>> results;
+
+    for (uint64_t c{0}; c < n_chunks; ++c)
+    {
+      uint64_t const begin = index.file_size * c / n_chunks;
+      uint64_t const end = index.file_size * (c + 1) / n_chunks;
+      results.push_back(pool.submit([=, &popvcf_fn]()
+                                    { return scan_chunk(fd, popvcf_fn, begin, end, index.file_size); }));
+    }
+
+    for (std::future<IndexChunk> & result : results)
+      chunks.push_back(result.get());
+
+    close(fd);
+  }
+
+  /// Join the chunks, the first block of a chunk continues the last block if its records are in the same block
+  int64_t last_pos{0};
+
+  for (IndexChunk & chunk : chunks)
+  {
+    if (chunk.blocks.empty())
+      continue;
+
+    auto first = chunk.blocks.begin();
+    std::vector<IndexedBlock> & blocks = index.blocks;
+
+    if (!blocks.empty() && is_same_block(blocks.back().contig, last_pos, first->contig, first->pos))
+    {
+      blocks.back().n_records += first->n_records;
+      ++first;
+    }
+
+    blocks.insert(blocks.end(), std::make_move_iterator(first), std::make_move_iterator(chunk.blocks.end()));
+    last_pos = chunk.last_pos;
+  }
+
+  std::string const index_fn = popvcf_fn + BLOCK_INDEX_SUFFIX;
+  index.write(index_fn);
+
+  uint64_t n_records{0};
+
+  for (IndexedBlock const & block : index.blocks)
+    n_records += block.n_records;
+
+  std::cerr << "[popvcf] Indexed " << index.blocks.size() << " blocks with " << n_records << " records in "
+            << index_fn << std::endl;
+}
+
+} // namespace popvcf
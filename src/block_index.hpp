@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace popvcf
+{
+char constexpr BLOCK_INDEX_SUFFIX[]{".pvi"}; //!< Suffix of the block index of a popVCF
+
+//! A block of a popVCF in the block index
+class IndexedBlock
+{
+public:
+  std::string contig{};
+  int64_t pos{0};        //!< POS of the first record of the block
+  uint64_t offset{0};    //!< File offset, or virtual offset if bgzipped, of the first record of the block
+  uint64_t n_records{0}; //!< Number of records of the block
+};
+
+//! Block index of a plain or bgzipped popVCF, a sidecar file with the offset of each block. Decoding a region starts
+//! at a block since the records of a block only refer to earlier records of the same block.
+class BlockIndex
+{
+public:
+  bool is_bgzf{false};                //!< True iff the popVCF is bgzipped and the offsets are virtual offsets
+  uint64_t file_size{0};              //!< Size of the popVCF when it was indexed, a different size means it changed
+  int64_t file_mtime{0};              //!< Modification time of the popVCF when it was indexed, in seconds
+  std::vector<IndexedBlock> blocks{}; //!< Blocks in the order of the popVCF, the header ends where the first begins
+
+  //! Writes the block index to \a fn.
+  void write(std::string const & fn) const;
+
+  //! Reads the block index in \a fn. Returns false if the file does not exist, exits if it cannot be parsed.
+  bool read(std::string const & fn);
+};
+
+//! Writes the block index of \a popvcf_fn to \a popvcf_fn.pvi. A plain popVCF is scanned in chunks by \a threads
+//! threads, a bgzipped popVCF is decompressed by \a threads threads and scanned by one.
+void index_file(std::string const & popvcf_fn, int const threads);
+
+} // namespace popvcf
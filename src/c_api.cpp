@@ -0,0 +1,159 @@
+#include "../include/popvcf.h"
+
+#include <charconv> // std::from_chars
+#include <exception>
+#include <fstream> // std::ifstream
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "reader.hpp"
+
+#include "htslib/tbx.h"
+
+struct popvcf_reader
+{
+  popvcf::RecordReader reader;
+  std::vector<std::string> sample_names{};
+
+  popvcf_reader(std::string const & path, std::string const & region)
+    : reader(path, region)
+    , sample_names(reader.get_sample_names())
+  {
+  }
+};
+
+namespace
+{
+thread_local std::string last_error{}; //!< Message of the last error of the thread
+
+} // namespace
+
+extern "C"
+{
+  int popvcf_abi_version(void)
+  {
+    return POPVCF_ABI_VERSION;
+  }
+
+  char const * popvcf_last_error(void)
+  {
+    return last_error.c_str();
+  }
+
+  popvcf_reader * popvcf_open(char const * path, char const * region)
+  {
+    last_error.clear();
+
+    /// The reader exits the process on files it cannot open, check them first
+    if (path == nullptr || !std::ifstream(path).is_open())
+    {
+      last_error = std::string("Could not open file ") + (path == nullptr ? "(null)" : path);
+      return nullptr;
+    }
+
+    bool const is_region = region != nullptr && region[0] != '\0';
+
+    if (is_region)
+    {
+      tbx_t * tbx = tbx_index_load(path);
+
+      if (tbx == nullptr)
+      {
+        last_error = std::string("Could not open the tabix index of ") + path;
+        return nullptr;
+      }
+
+      tbx_destroy(tbx);
+    }
+
+    try
+    {
+      return new popvcf_reader(path, is_region ? region : "");
+    }
+    catch (std::exception const & e)
+    {
+      last_error = e.what();
+      return nullptr;
+    }
+  }
+
+  void popvcf_close(popvcf_reader * reader)
+  {
+    delete reader;
+  }
+
+  char const * popvcf_header(popvcf_reader const * reader, size_t * size)
+  {
+    *size = reader->reader.header.size();
+    return reader->reader.header.data();
+  }
+
+  size_t popvcf_n_samples(popvcf_reader const * reader)
+  {
+    return reader->sample_names.size();
+  }
+
+  char const * popvcf_sample_name(popvcf_reader const * reader, size_t sample_index)
+  {
+    return reader->sample_names[sample_index].c_str();
+  }
+
+  int popvcf_next(popvcf_reader * reader)
+  {
+    last_error.clear();
+
+    try
+    {
+      if (!reader->reader.next())
+        return 0;
+    }
+    catch (std::exception const & e)
+    {
+      last_error = e.what();
+      return -1;
+    }
+
+    if (reader->reader.dd.field2uid.size() != reader->sample_names.size())
+    {
+      last_error = "Number of genotype fields does not match the number of samples at " +
+                   std::string(reader->reader.get_site_column(0)) + ':' +
+                   std::string(reader->reader.get_site_column(1));
+      return -1;
+    }
+
+    return 1;
+  }
+
+  char const * popvcf_site_column(popvcf_reader const * reader, int column_index, size_t * size)
+  {
+    std::string_view const column = reader->reader.get_site_column(column_index);
+    *size = column.size();
+    return column.data();
+  }
+
+  int64_t popvcf_pos(popvcf_reader const * reader)
+  {
+    std::string_view const column = reader->reader.get_site_column(1);
+    int64_t pos{0};
+    std::from_chars(column.data(), column.data() + column.size(), pos);
+    return pos;
+  }
+
+  size_t popvcf_n_unique_fields(popvcf_reader const * reader)
+  {
+    return reader->reader.dd.unique_fields.size();
+  }
+
+  char const * popvcf_unique_field(popvcf_reader const * reader, size_t uid, size_t * size)
+  {
+    std::string const & field = reader->reader.dd.unique_fields[uid];
+    *size = field.size();
+    return field.c_str();
+  }
+
+  uint32_t const * popvcf_field2uid(popvcf_reader const * reader)
+  {
+    return reader->reader.dd.field2uid.data();
+  }
+}
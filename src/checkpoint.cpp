@@ -0,0 +1,173 @@
+#include "checkpoint.hpp"
+
+#include <charconv>    // std::from_chars
+#include <cstdio>      // std::rename
+#include <cstdlib>     // std::exit
+#include <cstring>     // std::memchr
+#include <fstream>     // std::ifstream, std::ofstream
+#include <iostream>    // std::cerr
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+#include <zlib.h>
+
+#include "sequence_utils.hpp" // is_same_block, split_string
+
+namespace popvcf
+{
+namespace
+{
+//! Parses an integer column of a checkpoint line.
+template <typename T>
+bool parse_column(std::string_view const column, T & value)
+{
+  auto ret = std::from_chars(column.data(), column.data() + column.size(), value);
+  return ret.ec == std::errc() && ret.ptr == column.data() + column.size();
+}
+
+} // namespace
+
+uint32_t Checkpoint::get_options_checksum(FormatOptions const & options)
+{
+  if (!options.any())
+    return 0;
+
+  std::string const options_line = options.to_header_line();
+  return crc32(0, reinterpret_cast<Bytef const *>(options_line.data()), options_line.size());
+}
+
+void Checkpoint::write(std::string const & fn) const
+{
+  std::string const tmp_fn = fn + ".tmp";
+
+  {
+    std::ofstream out(tmp_fn);
+
+    if (!out.is_open())
+    {
+      std::cerr << "[popvcf] ERROR: Could not open checkpoint " << tmp_fn << " for writing." << std::endl;
+      std::exit(1);
+    }
+
+    out << "##popvcf_checkpoint=1\n"
+        << "#OPTIONS_CRC32\tOUTPUT_TYPE\tIN_OFFSET\tOUT_OFFSET\tFILE_OFFSET\n"
+        << options_checksum << '\t' << (is_bgzf_output ? 'z' : 'v') << '\t' << in_offset << '\t' << out_offset
+        << '\t' << file_offset << '\n';
+
+    if (!out.flush())
+    {
+      std::cerr << "[popvcf] ERROR: Could not write checkpoint " << tmp_fn << std::endl;
+      std::exit(1);
+    }
+  }
+
+  if (std::rename(tmp_fn.c_str(), fn.c_str()) != 0)
+  {
+    std::cerr << "[popvcf] ERROR: Could not rename " << tmp_fn << " to " << fn << std::endl;
+    std::exit(1);
+  }
+}
+
+bool Checkpoint::read(std::string const & fn)
+{
+  std::ifstream in(fn);
+
+  if (!in.is_open())
+    return false;
+
+  std::string line;
+  bool is_read{false};
+
+  while (std::getline(in, line))
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::vector<std::string_view> const columns = split_string(line, '\t');
+
+    if (columns.size() != 5 || !parse_column(columns[0], options_checksum) ||
+        (columns[1] != "z" && columns[1] != "v") || !parse_column(columns[2], in_offset) ||
+        !parse_column(columns[3], out_offset) || !parse_column(columns[4], file_offset))
+    {
+      std::cerr << "[popvcf] ERROR: Could not parse line of checkpoint " << fn << ": " << line << std::endl;
+      std::exit(1);
+    }
+
+    is_bgzf_output = columns[1] == "z";
+    is_read = true;
+  }
+
+  if (!is_read)
+  {
+    std::cerr << "[popvcf] ERROR: No checkpoint in " << fn << std::endl;
+    std::exit(1);
+  }
+
+  return true;
+}
+
+std::size_t BlockStartFinder::find(char const * data,
+                                   std::size_t const size,
+                                   uint64_t const data_offset,
+                                   uint64_t const min_offset)
+{
+  std::size_t found{std::string::npos};
+  std::size_t p{0};
+
+  while (p < size)
+  {
+    if (is_in_head)
+    {
+      /// Read CHROM and POS, which may continue in the next buffer
+      for (; p < size; ++p)
+      {
+        char const c = data[p];
+
+        if (c == '\n' || (c == '\t' && ++n_head_tabs == 2))
+          break;
+
+        head.push_back(c);
+      }
+
+      if (p == size)
+        break;
+
+      is_in_head = false;
+      std::size_t const tab = head.find('\t');
+
+      if (!head.empty() && head[0] != '#' && tab != std::string::npos)
+      {
+        std::string_view const contig(head.data(), tab);
+        int64_t pos{0};
+        std::from_chars(head.data() + tab + 1, head.data() + head.size(), pos);
+
+        if (!is_same_block(contig, pos, prev_contig, prev_pos))
+        {
+          if (found == std::string::npos && head_offset >= data_offset && head_offset >= min_offset)
+            found = head_offset - data_offset;
+
+          prev_contig.assign(contig);
+        }
+
+        prev_pos = pos;
+      }
+    }
+
+    /// Skip to the next line
+    char const * newline = static_cast<char const *>(std::memchr(data + p, '\n', size - p));
+
+    if (newline == nullptr)
+      break;
+
+    p = newline - data + 1;
+    is_in_head = true;
+    n_head_tabs = 0;
+    head_offset = data_offset + p;
+    head.resize(0);
+  }
+
+  return found;
+}
+
+} // namespace popvcf
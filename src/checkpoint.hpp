@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "format.hpp"
+
+namespace popvcf
+{
+char constexpr CHECKPOINT_SUFFIX[]{".ckpt"}; //!< Suffix of the checkpoint of a popVCF that is being encoded
+
+//! Point from which an interrupted encoding is resumed, which is the start of a record that begins a block. The
+//! encoder has no state there besides its options, so the rest of the input can be encoded by a new encoder and
+//! appended to the output up to the checkpoint.
+class Checkpoint
+{
+public:
+  uint32_t options_checksum{0}; //!< CRC32 of the options header lines of the output
+  bool is_bgzf_output{false};   //!< True iff the output is bgzipped
+  uint64_t in_offset{0};        //!< Offset of the record in the uncompressed input
+  uint64_t out_offset{0};       //!< Offset of the record in the uncompressed output
+  uint64_t file_offset{0};      //!< Size of the output file before the record. A BGZF block ends there if bgzipped
+
+  //! Returns the options_checksum of output encoded with \a options.
+  static uint32_t get_options_checksum(FormatOptions const & options);
+
+  //! Writes the checkpoint to \a fn. It is written to a temporary file first, so \a fn always has a whole checkpoint.
+  void write(std::string const & fn) const;
+
+  //! Reads the checkpoint in \a fn. Returns false if the file does not exist, exits if it cannot be parsed.
+  bool read(std::string const & fn);
+};
+
+//! Finds the records of a VCF that begin a block while the VCF is read in buffers.
+class BlockStartFinder
+{
+public:
+  //! Looks at the input buffer \a data of \a size bytes, which is at \a data_offset in the input. Returns the index in
+  //! \a data of the first record of the buffer that begins a block and is at \a min_offset in the input or later, or
+  //! npos if there is none.
+  std::size_t find(char const * data, std::size_t const size, uint64_t const data_offset, uint64_t const min_offset);
+
+private:
+  bool is_in_head{true};     //!< True iff the CHROM and POS of the current line have not been read yet
+  int n_head_tabs{0};        //!< Tabs in the start of the current line so far
+  uint64_t head_offset{0};   //!< Offset of the current line in the input
+  std::string head{};        //!< CHROM and POS of the current line so far
+  std::string prev_contig{}; //!< CHROM of the previous record
+  int64_t prev_pos{-1};      //!< POS of the previous record
+};
+
+} // namespace popvcf
@@ -0,0 +1,392 @@
+#include "compare.hpp"
+
+#include <algorithm>   // std::sort, std::any_of
+#include <cstdint>     // uint32_t, uint64_t
+#include <cstdio>      // fwrite, snprintf
+#include <iostream>    // std::cerr
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+#include <parallel_hashmap/phmap.h> // phmap::flat_hash_map
+
+#include "genotype.hpp"
+#include "io.hpp"
+#include "reader.hpp"
+#include "sequence_utils.hpp" // get_vcf_pos, split_string
+
+namespace popvcf
+{
+namespace
+{
+uint32_t constexpr MISSING_GT{0}; //!< Genotype id of a missing genotype, or of a record without GT
+
+//! Record of one of the compared popVCFs, copied from its reader
+class CompareRecord
+{
+public:
+  std::string site{};                       //!< CHROM to ALT, each followed by a tab
+  std::string alleles{};                    //!< REF and ALT
+  bool has_gt{false};                       //!< True iff GT is the first key of FORMAT
+  std::vector<std::string> unique_fields{}; //!< Unique genotype fields
+  std::vector<uint32_t> field2uid{};        //!< Unique genotype field of each sample
+};
+
+//! A popVCF that is compared, which is read one position at a time
+class CompareInput
+{
+public:
+  RecordReader reader;
+  std::vector<CompareRecord> group{}; //!< Records at the current position, the first n_group are used
+  std::size_t n_group{0};             //!< Number of records at the current position
+  std::string contig{};               //!< Contig of the current position
+  long pos{0};                        //!< Current position
+  bool is_pending{false};             //!< True iff the reader has a record after the current position
+
+  explicit CompareInput(std::string const & popvcf_fn)
+    : reader(popvcf_fn)
+  {
+    is_pending = reader.next();
+  }
+
+  //! Reads the records at the next position. n_group is 0 at the end of the popVCF.
+  void read_group()
+  {
+    n_group = 0;
+
+    if (!is_pending)
+      return;
+
+    contig.assign(reader.get_site_column(0));
+    pos = get_vcf_pos(reader.site.data(), reader.site.data() + reader.site.size());
+
+    do
+    {
+      if (n_group == group.size())
+        group.emplace_back();
+
+      CompareRecord & record = group[n_group++];
+      record.site.resize(0);
+
+      for (long c{0}; c < 5; ++c)
+        record.site.append(reader.get_site_column(c)).push_back('\t');
+
+      record.alleles.assign(reader.get_site_column(3)).push_back('\t');
+      record.alleles.append(reader.get_site_column(4));
+      std::string_view const format = reader.get_site_column(8);
+      record.has_gt = format.substr(0, 2) == "GT" && (format.size() == 2 || format[2] == ':');
+      record.unique_fields.assign(reader.dd.unique_fields.begin(), reader.dd.unique_fields.end());
+      record.field2uid.assign(reader.dd.field2uid.begin(), reader.dd.field2uid.end());
+      is_pending = reader.next();
+    } while (is_pending && reader.get_site_column(0) == contig &&
+             get_vcf_pos(reader.site.data(), reader.site.data() + reader.site.size()) == pos);
+  }
+};
+
+//! Orders contigs by the ##contig header lines of both popVCFs, and contigs without one by when they are first seen
+class ContigOrder
+{
+public:
+  void add_header(std::vector<char> const & header)
+  {
+    std::string_view const prefix{"##contig=<ID="};
+    std::string_view const lines(header.data(), header.size());
+
+    for (std::string_view const line : split_string(lines, '\n'))
+    {
+      if (line.substr(0, prefix.size()) == prefix)
+      {
+        std::string_view const id = line.substr(prefix.size(), line.find_first_of(",>") - prefix.size());
+        ranks.emplace(std::string(id), ranks.size());
+      }
+    }
+  }
+
+  std::size_t get_rank(std::string const & contig)
+  {
+    return ranks.emplace(contig, ranks.size()).first->second;
+  }
+
+private:
+  phmap::flat_hash_map<std::string, std::size_t> ranks{};
+};
+
+//! Concordance counts of a record or a sample
+class Concordance
+{
+public:
+  uint64_t n_match{0};
+  uint64_t n_mismatch{0};
+  uint64_t n_missing{0}; //!< Genotypes that are missing in either popVCF
+
+  //! Appends the counts and the concordance, each preceded by a tab.
+  void append(std::string & line) const
+  {
+    for (uint64_t const n : {n_match, n_mismatch, n_missing})
+    {
+      line.push_back('\t');
+      line.append(std::to_string(n));
+    }
+
+    line.push_back('\t');
+
+    if (n_match + n_mismatch == 0)
+    {
+      line.push_back('.');
+    }
+    else
+    {
+      char buffer[32];
+      int const n = snprintf(buffer, sizeof(buffer), "%.6g", static_cast<double>(n_match) / (n_match + n_mismatch));
+      line.append(buffer, n);
+    }
+  }
+};
+
+//! Sets the genotype id of each unique genotype field of \a record. Equal genotypes get the same id regardless of
+//! phase and of the other subfields.
+void set_gt_ids(CompareRecord const & record,
+                std::vector<uint32_t> & gt_ids,
+                phmap::flat_hash_map<std::string, uint32_t> & gt2id,
+                std::vector<int32_t> & alleles,
+                std::string & key)
+{
+  gt_ids.assign(record.unique_fields.size(), MISSING_GT);
+
+  if (!record.has_gt)
+    return;
+
+  for (std::size_t uid{0}; uid < record.unique_fields.size(); ++uid)
+  {
+    parse_gt(record.unique_fields[uid], alleles);
+
+    if (alleles.empty() || std::any_of(alleles.begin(), alleles.end(), [](int32_t a) { return a == MISSING_ALLELE; }))
+      continue;
+
+    std::sort(alleles.begin(), alleles.end());
+    key.resize(0);
+
+    for (int32_t const allele : alleles)
+      key.append(std::to_string(allele)).push_back('/');
+
+    gt_ids[uid] = gt2id.emplace(key, gt2id.size() + 1).first->second;
+  }
+}
+
+} // namespace
+
+void compare_files(std::string const & popvcf_fn_a, std::string const & popvcf_fn_b, std::string const & per_sample_fn)
+{
+  CompareInput a(popvcf_fn_a);
+  CompareInput b(popvcf_fn_b);
+  ContigOrder contig_order;
+  contig_order.add_header(a.reader.header);
+  contig_order.add_header(b.reader.header);
+
+  /// Samples are matched by name, in the order of the first popVCF
+  std::vector<std::string> const names_a = a.reader.get_sample_names();
+  std::vector<std::string> const names_b = b.reader.get_sample_names();
+  phmap::flat_hash_map<std::string, uint32_t> name2index_b;
+
+  for (uint32_t s{0}; s < names_b.size(); ++s)
+    name2index_b.emplace(names_b[s], s);
+
+  std::vector<uint32_t> samples_a; // index in the first popVCF of each shared sample
+  std::vector<uint32_t> samples_b; // index in the second popVCF of each shared sample
+
+  for (uint32_t s{0}; s < names_a.size(); ++s)
+  {
+    auto find_it = name2index_b.find(names_a[s]);
+
+    if (find_it != name2index_b.end())
+    {
+      samples_a.push_back(s);
+      samples_b.push_back(find_it->second);
+    }
+  }
+
+  if (samples_a.empty())
+    std::cerr << "[popvcf] WARNING: " << popvcf_fn_a << " and " << popvcf_fn_b << " have no samples in common.\n";
+
+  /// Records with identical genotype fields only match if the popVCFs have the same samples in the same order
+  bool const is_same_samples = names_a == names_b;
+
+  std::vector<Concordance> per_sample(samples_a.size());
+  Concordance total;
+  uint64_t n_both{0};      // records in both popVCFs
+  uint64_t n_identical{0}; // records in both popVCFs with the same unique genotype fields and field2uid
+  uint64_t n_only_a{0};
+  uint64_t n_only_b{0};
+
+  std::vector<uint32_t> gt_ids_a;                    // genotype id of each unique field in the first popVCF
+  std::vector<uint32_t> gt_ids_b;                    // genotype id of each unique field in the second popVCF
+  phmap::flat_hash_map<std::string, uint32_t> gt2id; // ids of the genotypes of the current record
+  std::vector<int32_t> alleles;
+  std::string key;
+  std::string line = "#CHROM\tPOS\tID\tREF\tALT\tSTATUS\tN_MATCH\tN_MISMATCH\tN_MISSING\tCONCORDANCE\n";
+  fwrite(line.data(), 1, line.size(), stdout);
+
+  auto write_only = [&](CompareRecord const & record, char const * status)
+  {
+    line.assign(record.site).append(status);
+    Concordance().append(line);
+    line.push_back('\n');
+    fwrite(line.data(), 1, line.size(), stdout);
+  };
+
+  a.read_group();
+  b.read_group();
+
+  while (a.n_group > 0 || b.n_group > 0)
+  {
+    /// Compare the positions, a popVCF that has ended is after the other
+    int order{0};
+
+    if (a.n_group == 0)
+      order = 1;
+    else if (b.n_group == 0)
+      order = -1;
+    else if (a.contig != b.contig)
+      order = contig_order.get_rank(a.contig) < contig_order.get_rank(b.contig) ? -1 : 1;
+    else if (a.pos != b.pos)
+      order = a.pos < b.pos ? -1 : 1;
+
+    if (order < 0)
+    {
+      for (std::size_t r{0}; r < a.n_group; ++r)
+        write_only(a.group[r], "only_a");
+
+      n_only_a += a.n_group;
+      a.read_group();
+      continue;
+    }
+    else if (order > 0)
+    {
+      for (std::size_t r{0}; r < b.n_group; ++r)
+        write_only(b.group[r], "only_b");
+
+      n_only_b += b.n_group;
+      b.read_group();
+      continue;
+    }
+
+    /// Match the records at the same position by REF and ALT
+    std::vector<bool> is_matched_b(b.n_group, false);
+
+    for (std::size_t ra{0}; ra < a.n_group; ++ra)
+    {
+      CompareRecord const & record_a = a.group[ra];
+      std::size_t rb{0};
+
+      while (rb < b.n_group && (is_matched_b[rb] || b.group[rb].alleles != record_a.alleles))
+        ++rb;
+
+      if (rb == b.n_group)
+      {
+        write_only(record_a, "only_a");
+        ++n_only_a;
+        continue;
+      }
+
+      is_matched_b[rb] = true;
+      CompareRecord const & record_b = b.group[rb];
+      ++n_both;
+
+      /// Each unique genotype field is parsed once
+      gt2id.clear();
+      set_gt_ids(record_a, gt_ids_a, gt2id, alleles, key);
+      Concordance site;
+
+      if (!record_a.has_gt || !record_b.has_gt)
+      {
+        /// Records without GT only have missing genotypes
+        for (Concordance & sample : per_sample)
+          ++sample.n_missing;
+
+        site.n_missing = samples_a.size();
+      }
+      else if (is_same_samples && record_a.field2uid == record_b.field2uid &&
+               record_a.unique_fields == record_b.unique_fields)
+      {
+        /// Identical records cannot differ, only missing genotypes are counted
+        ++n_identical;
+
+        for (std::size_t s{0}; s < samples_a.size(); ++s)
+        {
+          bool const is_missing = gt_ids_a[record_a.field2uid[s]] == MISSING_GT;
+          ++(is_missing ? per_sample[s].n_missing : per_sample[s].n_match);
+          ++(is_missing ? site.n_missing : site.n_match);
+        }
+      }
+      else
+      {
+        set_gt_ids(record_b, gt_ids_b, gt2id, alleles, key);
+
+        for (std::size_t s{0}; s < samples_a.size(); ++s)
+        {
+          uint32_t const gt_a = gt_ids_a[record_a.field2uid[samples_a[s]]];
+          uint32_t const gt_b = gt_ids_b[record_b.field2uid[samples_b[s]]];
+
+          if (gt_a == MISSING_GT || gt_b == MISSING_GT)
+          {
+            ++per_sample[s].n_missing;
+            ++site.n_missing;
+          }
+          else if (gt_a == gt_b)
+          {
+            ++per_sample[s].n_match;
+            ++site.n_match;
+          }
+          else
+          {
+            ++per_sample[s].n_mismatch;
+            ++site.n_mismatch;
+          }
+        }
+      }
+
+      total.n_match += site.n_match;
+      total.n_mismatch += site.n_mismatch;
+      total.n_missing += site.n_missing;
+      line.assign(record_a.site).append("both");
+      site.append(line);
+      line.push_back('\n');
+      fwrite(line.data(), 1, line.size(), stdout);
+    }
+
+    for (std::size_t rb{0}; rb < b.n_group; ++rb)
+    {
+      if (!is_matched_b[rb])
+      {
+        write_only(b.group[rb], "only_b");
+        ++n_only_b;
+      }
+    }
+
+    a.read_group();
+    b.read_group();
+  }
+
+  /// Concordance of each sample
+  if (!per_sample_fn.empty())
+  {
+    file_ptr out = popvcf::open_vcf(per_sample_fn, "w");
+    line = "#SAMPLE\tN_MATCH\tN_MISMATCH\tN_MISSING\tCONCORDANCE\n";
+
+    for (std::size_t s{0}; s < samples_a.size(); ++s)
+    {
+      line.append(names_a[samples_a[s]]);
+      per_sample[s].append(line);
+      line.push_back('\n');
+    }
+
+    fwrite(line.data(), 1, line.size(), out.get());
+  }
+
+  std::cerr << "[popvcf] Compared " << n_both << " records in both popVCFs (" << n_identical
+            << " with identical genotype fields), " << n_only_a << " only in " << popvcf_fn_a << " and " << n_only_b
+            << " only in " << popvcf_fn_b << ". " << total.n_match << " genotypes match, " << total.n_mismatch
+            << " do not and " << total.n_missing << " are missing." << std::endl;
+}
+
+} // namespace popvcf
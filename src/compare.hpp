@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+namespace popvcf
+{
+//! Compares the genotypes of two popVCFs with the same contig order and writes the genotype concordance of each
+//! record to standard output, and of each sample to \a per_sample_fn if it is not empty. Records are matched by CHROM,
+//! POS, REF and ALT, and samples by name. Genotypes are compared by their GT alleles regardless of phase. The GT of
+//! each unique genotype field is parsed once per record, and records with identical unique genotype fields and
+//! field2uid in both files are counted without parsing the genotypes of the second file.
+void compare_files(std::string const & popvcf_fn_a, std::string const & popvcf_fn_b, std::string const & per_sample_fn);
+
+} // namespace popvcf
@@ -0,0 +1,272 @@
+#include "concat.hpp"
+
+#include <algorithm> // std::copy, std::min
+#include <array>     // std::array
+#include <cstdint>   // uint64_t
+#include <cstdio>    // SEEK_SET
+#include <cstring>   // std::memcmp
+#include <iostream>  // std::cerr
+#include <string>    // std::string
+#include <vector>    // std::vector
+
+#include "format.hpp"
+#include "io.hpp"
+
+#include "htslib/bgzf.h"
+#include "htslib/hfile.h"
+#include "htslib/kstring.h"
+#include "htslib/tbx.h"
+
+namespace popvcf
+{
+namespace
+{
+//! The empty block htslib writes at the end of every bgzf file.
+std::array<char, 28> constexpr BGZF_EOF_BLOCK = {'\x1f', '\x8b', '\x08', '\x04', '\x00', '\x00', '\x00',
+                                                 '\x00', '\x00', '\xff', '\x06', '\x00', '\x42', '\x43',
+                                                 '\x02', '\x00', '\x1b', '\x00', '\x03', '\x00', '\x00',
+                                                 '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00'};
+
+long constexpr RAW_BUFFER_SIZE{4 * 65536}; //!< Size of the buffer used when copying raw bgzf blocks
+
+//! Returns the "#CHROM" line of a header, which must be identical in files that are joined.
+std::string get_column_header_line(std::string const & header)
+{
+  std::size_t const pos = header.rfind("\n#CHROM");
+
+  if (pos == std::string::npos)
+    return header.compare(0, 6, "#CHROM") == 0 ? header : std::string();
+
+  return header.substr(pos + 1);
+}
+
+//! Returns the header lines describing the encoding, which must be identical in files that are joined.
+std::string get_popvcf_header_lines(std::string const & header)
+{
+  std::string lines;
+  std::size_t b{0};
+
+  while (b < header.size())
+  {
+    std::size_t const e = header.find('\n', b);
+    std::size_t const line_end = e == std::string::npos ? header.size() : e + 1;
+
+    if (header.compare(b, POPVCF_HEADER_PREFIX.size(), POPVCF_HEADER_PREFIX) == 0)
+      lines.append(header, b, line_end - b);
+
+    b = line_end;
+  }
+
+  return lines;
+}
+
+} // namespace
+
+void read_bgzf_header(BGZF * in_bgzf, std::string & header)
+{
+  kstring_t str = {0, 0, nullptr};
+
+  while (bgzf_peek(in_bgzf) == '#')
+  {
+    if (bgzf_getline(in_bgzf, '\n', &str) < 0)
+      break;
+
+    header.append(str.s, str.l);
+    header.push_back('\n');
+  }
+
+  free(str.s);
+}
+
+void copy_bgzf_blocks(BGZF * in_bgzf, BGZF * out_bgzf)
+{
+  /// Recompress what is left of the block the header (or anything else) was read from
+  if (in_bgzf->block_offset < in_bgzf->block_length)
+  {
+    char const * data = static_cast<char const *>(in_bgzf->uncompressed_block);
+    popvcf::write_bgzf(out_bgzf, data + in_bgzf->block_offset, in_bgzf->block_length - in_bgzf->block_offset);
+    in_bgzf->block_offset = in_bgzf->block_length;
+  }
+
+  if (bgzf_flush(out_bgzf) != 0)
+  {
+    std::cerr << "[popvcf] ERROR: Failed flushing bgzf output." << std::endl;
+    std::exit(1);
+  }
+
+  /// Copy the remaining blocks as they are, but hold back the last bytes in case they are an EOF block
+  std::size_t const EOF_SIZE = BGZF_EOF_BLOCK.size();
+  std::vector<char> buffer(RAW_BUFFER_SIZE + EOF_SIZE);
+  std::size_t carry{0};
+
+  while (true)
+  {
+    ssize_t const n = bgzf_raw_read(in_bgzf, buffer.data() + carry, RAW_BUFFER_SIZE);
+
+    if (n < 0)
+    {
+      std::cerr << "[popvcf] ERROR: Failed reading bgzf blocks." << std::endl;
+      std::exit(1);
+    }
+
+    if (n == 0)
+      break;
+
+    std::size_t const total = carry + n;
+
+    if (total <= EOF_SIZE)
+    {
+      carry = total;
+      continue;
+    }
+
+    if (bgzf_raw_write(out_bgzf, buffer.data(), total - EOF_SIZE) != static_cast<ssize_t>(total - EOF_SIZE))
+    {
+      std::cerr << "[popvcf] ERROR: Failed writing bgzf blocks." << std::endl;
+      std::exit(1);
+    }
+
+    std::copy(buffer.data() + total - EOF_SIZE, buffer.data() + total, buffer.data());
+    carry = EOF_SIZE;
+  }
+
+  bool const is_eof_block =
+    carry == EOF_SIZE && std::memcmp(buffer.data(), BGZF_EOF_BLOCK.data(), EOF_SIZE) == 0;
+
+  if (!is_eof_block && carry > 0 && bgzf_raw_write(out_bgzf, buffer.data(), carry) != static_cast<ssize_t>(carry))
+  {
+    std::cerr << "[popvcf] ERROR: Failed writing bgzf blocks." << std::endl;
+    std::exit(1);
+  }
+}
+
+void copy_bgzf_range(BGZF * in_bgzf, BGZF * out_bgzf, uint64_t const begin, uint64_t const end)
+{
+  uint64_t const end_address = end >> 16;
+  std::size_t const end_offset = end & 0xFFFF;
+
+  /// Recompress the data of the first block from begin
+  auto read_block_at = [in_bgzf](uint64_t const voffset)
+  {
+    // the block is loaded by bgzf_seek or, if block_length is 0, on the next read
+    if (bgzf_seek(in_bgzf, voffset & ~uint64_t{0xFFFF}, SEEK_SET) < 0 ||
+        (in_bgzf->block_length == 0 && bgzf_read_block(in_bgzf) != 0))
+    {
+      std::cerr << "[popvcf] ERROR: Failed reading bgzf block at " << (voffset >> 16) << std::endl;
+      std::exit(1);
+    }
+
+    in_bgzf->block_offset = voffset & 0xFFFF;
+    return static_cast<char const *>(in_bgzf->uncompressed_block);
+  };
+
+  char const * data = read_block_at(begin);
+
+  if ((begin >> 16) == end_address)
+  {
+    popvcf::write_bgzf(out_bgzf, data + in_bgzf->block_offset, end_offset - in_bgzf->block_offset);
+    return;
+  }
+
+  popvcf::write_bgzf(out_bgzf, data + in_bgzf->block_offset, in_bgzf->block_length - in_bgzf->block_offset);
+
+  if (bgzf_flush(out_bgzf) != 0)
+  {
+    std::cerr << "[popvcf] ERROR: Failed flushing bgzf output." << std::endl;
+    std::exit(1);
+  }
+
+  /// Copy the blocks up to the block of end as they are
+  int64_t const next_address = htell(in_bgzf->fp);
+  std::vector<char> buffer(RAW_BUFFER_SIZE);
+
+  for (uint64_t n_left = end_address - next_address; n_left > 0;)
+  {
+    ssize_t const n = bgzf_raw_read(in_bgzf, buffer.data(), std::min<uint64_t>(n_left, buffer.size()));
+
+    if (n <= 0)
+    {
+      std::cerr << "[popvcf] ERROR: Failed reading bgzf blocks." << std::endl;
+      std::exit(1);
+    }
+
+    if (bgzf_raw_write(out_bgzf, buffer.data(), n) != n)
+    {
+      std::cerr << "[popvcf] ERROR: Failed writing bgzf blocks." << std::endl;
+      std::exit(1);
+    }
+
+    n_left -= n;
+  }
+
+  /// Recompress the data of the last block up to end
+  if (end_offset > 0)
+  {
+    data = read_block_at(end_address << 16);
+    popvcf::write_bgzf(out_bgzf, data, end_offset);
+  }
+}
+
+void concat_files(std::vector<std::string> const & input_fns, std::string const & output_fn, bool const write_index)
+{
+  if (write_index && output_fn == "-")
+  {
+    std::cerr << "[popvcf] ERROR: Cannot write an index when the output is standard output." << std::endl;
+    std::exit(1);
+  }
+
+  std::string first_column_header_line;
+  std::string first_popvcf_header_lines;
+
+  {
+    popvcf::bgzf_ptr out_bgzf = popvcf::open_bgzf(output_fn, "w");
+
+    for (long f{0}; f < static_cast<long>(input_fns.size()); ++f)
+    {
+      std::string const & fn = input_fns[f];
+      popvcf::bgzf_ptr in_bgzf = popvcf::open_bgzf(fn, "r");
+
+      if (bgzf_compression(in_bgzf.get()) != bgzf)
+      {
+        std::cerr << "[popvcf] ERROR: " << fn << " is not bgzipped. Encode it with '-Oz' before concatenating."
+                  << std::endl;
+        std::exit(1);
+      }
+
+      std::string header;
+      read_bgzf_header(in_bgzf.get(), header);
+      std::string column_header_line = get_column_header_line(header);
+
+      std::string popvcf_header_lines = get_popvcf_header_lines(header);
+
+      if (f == 0)
+      {
+        first_column_header_line = std::move(column_header_line);
+        first_popvcf_header_lines = std::move(popvcf_header_lines);
+        popvcf::write_bgzf(out_bgzf.get(), header.data(), header.size());
+      }
+      else if (column_header_line != first_column_header_line)
+      {
+        std::cerr << "[popvcf] ERROR: The samples of " << fn << " do not match the samples of " << input_fns[0]
+                  << std::endl;
+        std::exit(1);
+      }
+      else if (popvcf_header_lines != first_popvcf_header_lines)
+      {
+        std::cerr << "[popvcf] ERROR: " << fn << " was encoded with different options than " << input_fns[0]
+                  << std::endl;
+        std::exit(1);
+      }
+
+      copy_bgzf_blocks(in_bgzf.get(), out_bgzf.get());
+    }
+  } // closes the output file
+
+  if (write_index && tbx_index_build(output_fn.c_str(), 0, &tbx_conf_vcf) != 0)
+  {
+    std::cerr << "[popvcf] ERROR: Failed building a tabix index for " << output_fn << std::endl;
+    std::exit(1);
+  }
+}
+
+} // namespace popvcf
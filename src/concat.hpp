@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class BGZF;
+
+namespace popvcf
+{
+//! Reads the header lines of a bgzf stream into \a header. The stream is left at the first record.
+void read_bgzf_header(BGZF * in_bgzf, std::string & header);
+
+//! Copies the rest of a bgzf stream into \a out_bgzf without inflating. Data left in the current block is recompressed.
+void copy_bgzf_blocks(BGZF * in_bgzf, BGZF * out_bgzf);
+
+//! Copies the data of a bgzf stream from virtual offset \a begin up to virtual offset \a end into \a out_bgzf. The
+//! blocks in between are copied without inflating, the data in the blocks of \a begin and \a end is recompressed.
+void copy_bgzf_range(BGZF * in_bgzf, BGZF * out_bgzf, uint64_t const begin, uint64_t const end);
+
+//! Concatenate bgzipped popVCF files into one. Only the first header is kept.
+void concat_files(std::vector<std::string> const & input_fns, std::string const & output_fn, bool const write_index);
+
+} // namespace popvcf
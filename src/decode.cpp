@@ -5,13 +5,21 @@
 #include <charconv>
 #include <cstdio>   // std::stdin
 #include <cstring>  // std::memmove
+#include <fstream>  // std::ifstream
 #include <iostream> // std::cerr
+#include <limits>   // std::numeric_limits
 #include <memory>
 #include <stdexcept>
 #include <string> // std::string
 #include <vector> // std::vector
 
+#include <fcntl.h>  // open
+#include <unistd.h> // STDOUT_FILENO, close, pread
+
+#include "block_index.hpp"
+#include "gather_output.hpp"
 #include "io.hpp"
+#include "pipeline.hpp"
 #include "sequence_utils.hpp" // ascii_cstring_to_int
 
 #include "htslib/bgzf.h"
@@ -21,11 +29,15 @@
 
 namespace popvcf
 {
-void decode_file(std::string const & input_fn, bool const is_bgzf_input)
+void decode_file(std::string const & input_fn,
+                 bool const is_bgzf_input,
+                 bool const drop_genotypes,
+                 bool const is_writev)
 {
-  Tdec_array_buf buffer_in;     // input buffer
-  std::vector<char> buffer_out; // output buffer
-  DecodeData dd;                // data used to keep track of buffers while decoding
+  std::vector<char> buffer_in;            // input data that has not been decoded yet
+  DecodeData dd;                          // data used to keep track of buffers while decoding
+  GatherOutput gather_out(STDOUT_FILENO); // output with is_writev, the writer thread then gets no output
+  dd.drop_genotypes = drop_genotypes;
 
   /// Input streams
   popvcf::bgzf_ptr in_bgzf(nullptr, popvcf::close_bgzf);
@@ -37,116 +49,257 @@ void decode_file(std::string const & input_fn, bool const is_bgzf_input)
   else
     in_vcf = popvcf::open_vcf(input_fn, "r");
 
-  buffer_out.reserve(16 * DEC_BUFFER_SIZE);
+  buffer_in.reserve(2 * DEC_BUFFER_SIZE);
 
-  /// Read first batch of data
-  if (is_bgzf_input)
-    dd.in_size = bgzf_read(in_bgzf.get(), buffer_in.data(), DEC_BUFFER_SIZE);
-  else
-    dd.in_size = fread(buffer_in.data(), 1, DEC_BUFFER_SIZE, in_vcf.get());
+  /// Reading, decoding and writing run in separate threads
+  popvcf::run_pipeline(
+    DEC_BUFFER_SIZE,
+    [&](char * data, std::size_t const max_size) -> std::size_t
+    {
+      if (is_bgzf_input)
+        return popvcf::read_bgzf(in_bgzf.get(), data, max_size);
+      else
+        return fread(data, 1, max_size, in_vcf.get());
+    },
+    [&](char const * data, std::size_t const size, std::vector<char> & buffer_out)
+    {
+      if (size > 0)
+      {
+        // decode the new input, data of the last field that is not complete is kept in buffer_in
+        buffer_in.insert(buffer_in.end(), data, data + size);
+
+        if (is_writev)
+          decode_buffer</*in_region=*/false>(gather_out, buffer_in, dd);
+        else
+          decode_buffer</*in_region=*/false>(buffer_out, buffer_in, dd);
+      }
+      else if (dd.in_size != 0)
+      {
+        std::cerr << "[popvcf] WARNING: Unexpected ending of the VCF data, possibly the file is truncated.\n";
+
+        if (is_writev)
+          gather_out.insert(gather_out.end(), buffer_in.begin(), buffer_in.end());
+        else
+          buffer_out.insert(buffer_out.end(), buffer_in.begin(), buffer_in.end());
+      }
+    },
+    [&](char const * data, std::size_t const size)
+    {
+      fwrite(data, 1, size, stdout);
+    });
 
-  long new_bytes = dd.in_size;
+  if (is_writev)
+    gather_out.flush();
+}
 
-  /// Outer loop - loop while there is some data to decode from the input stream
-  while (new_bytes != 0)
+namespace
+{
+//! Decodes the records of \a chrom in the region of \a dd with the block index of the popVCF. Decoding starts at the
+//! first block that may have records in the region, a plain popVCF is read with pread.
+void decode_indexed_region(std::string const & popvcf_fn,
+                           BlockIndex const & index,
+                           std::string const & chrom,
+                           DecodeData & dd)
+{
+  /// A popVCF that was rewritten with the same size still has a different modification time
+  if (get_file_size(popvcf_fn) != index.file_size || get_file_mtime(popvcf_fn) != index.file_mtime)
   {
-    decode_buffer</*in_region=*/false>(buffer_out, buffer_in, dd);
+    std::cerr << "[popvcf] ERROR: " << popvcf_fn << " has changed since it was indexed. Index it again with "
+              << "'popvcf index'." << std::endl;
+    std::exit(1);
+  }
 
-    /// Write buffer_out to stdout
-    fwrite(buffer_out.data(), 1, buffer_out.size(), stdout);
-    buffer_out.resize(0); // Clears output buffer, but does not deallocate
-    new_bytes = -static_cast<long>(dd.in_size);
+  std::vector<char> buffer_in; // input buffer
+  buffer_in.reserve(2 * DEC_BUFFER_SIZE);
+  std::vector<char> buffer_out; // output buffer
+  std::vector<IndexedBlock> const & blocks = index.blocks;
+  uint64_t header_end = blocks.empty() ? index.file_size : blocks[0].offset; // the header is before the first block
 
-    /// Read more data
-    if (is_bgzf_input)
-      dd.in_size += bgzf_read(in_bgzf.get(), buffer_in.data() + dd.in_size, DEC_BUFFER_SIZE - dd.in_size);
-    else
-      dd.in_size += fread(buffer_in.data() + dd.in_size, 1, DEC_BUFFER_SIZE - dd.in_size, in_vcf.get());
+  if (blocks.empty() && index.is_bgzf)
+    header_end = std::numeric_limits<uint64_t>::max();
 
-    new_bytes += dd.in_size;
-  } /// ends outer loop
+  popvcf::bgzf_ptr in_bgzf(nullptr, popvcf::close_bgzf);
+  int fd{-1};
 
-  assert(buffer_out.size() == 0);
+  auto write_buffer_out = [&]()
+  {
+    fwrite(buffer_out.data(), 1, buffer_out.size(), stdout);
+    buffer_out.resize(0);
+  };
 
-  if (dd.in_size != 0)
+  /// Reads the plain popVCF from offset begin to end and decodes it
+  auto decode_range = [&](uint64_t offset, uint64_t const end)
   {
-    std::cerr << "[popvcf] WARNING: Unexpected ending of the VCF data, possibly the file is truncated.\n";
+    while (offset < end)
+    {
+      std::size_t const in_size = buffer_in.size();
+      buffer_in.resize(in_size + std::min<uint64_t>(DEC_BUFFER_SIZE, end - offset));
+      ssize_t const size = pread(fd, buffer_in.data() + in_size, buffer_in.size() - in_size, offset);
+
+      if (size <= 0)
+      {
+        std::cerr << "[popvcf] ERROR: Could not read " << popvcf_fn << " at offset " << offset << std::endl;
+        std::exit(1);
+      }
+
+      buffer_in.resize(in_size + size);
+      offset += size;
+      decode_buffer</*in_region=*/true>(buffer_out, buffer_in, dd);
+      write_buffer_out();
+    }
+  };
 
-    // write output buffer
-    fwrite(buffer_in.data(), 1, dd.in_size, stdout); // write output buffer
-  }
-}
+  /// Reads n_records lines of the bgzipped popVCF and decodes them
+  kstring_t str = {0, 0, 0};
 
-void decode_region(std::string const & popvcf_fn, std::string const & region)
-{
-  assert(region.size() > 0);
-  std::vector<char> buffer_in; // input buffer
-  buffer_in.reserve(DEC_BUFFER_SIZE);
-  std::vector<char> buffer_out; // output buffer
-  DecodeData dd;                // data used to keep track of buffers while decoding
+  auto decode_lines = [&](uint64_t const n_records)
+  {
+    for (uint64_t r{0}; r < n_records && bgzf_getline(in_bgzf.get(), '\n', &str) >= 0; ++r)
+    {
+      buffer_in.insert(buffer_in.end(), str.s, str.s + str.l);
+      buffer_in.push_back('\n');
+      decode_buffer</*in_region=*/true>(buffer_out, buffer_in, dd);
 
-  /// parse region
-  std::string chrom;
-  long begin{-1};
-  long end{std::numeric_limits<long>::max()};
+      if (static_cast<long>(buffer_out.size()) >= DEC_BUFFER_SIZE)
+        write_buffer_out();
+    }
 
-  if (auto colon = region.find(':'); colon == std::string::npos)
+    write_buffer_out();
+  };
+
+  /// Write the header lines, which are decoded as well since they may describe the encoding
+  if (index.is_bgzf)
   {
-    chrom = region;
+    in_bgzf = popvcf::open_bgzf(popvcf_fn, "r");
+
+    while (static_cast<uint64_t>(bgzf_tell(in_bgzf.get())) < header_end && bgzf_getline(in_bgzf.get(), '\n', &str) >= 0)
+    {
+      buffer_in.insert(buffer_in.end(), str.s, str.s + str.l);
+      buffer_in.push_back('\n');
+      decode_buffer</*in_region=*/true>(buffer_out, buffer_in, dd);
+    }
+
+    write_buffer_out();
   }
   else
   {
-    chrom = region.substr(0, colon);
+    fd = open(popvcf_fn.c_str(), O_RDONLY);
 
-    if (auto dash = region.find('-', colon + 1); dash == std::string::npos)
+    if (fd < 0)
     {
-      auto ret = std::from_chars(region.data() + colon + 1, region.data() + region.size(), begin);
+      std::cerr << "[popvcf] ERROR: Could not open " << popvcf_fn << std::endl;
+      std::exit(1);
+    }
+
+    decode_range(0, header_end);
+  }
 
-      if (ret.ec != std::errc())
-        throw std::runtime_error("Could not parse region: " + region);
+  /// Records of a block are not before the first record of the next block, unless the popVCF is not sorted
+  FormatOptions const options = dd.options;
+  std::size_t b{0};
 
-      end = begin;
+  while (b < blocks.size())
+  {
+    if (blocks[b].contig != chrom || blocks[b].pos > dd.end ||
+        (b + 1 < blocks.size() && blocks[b + 1].contig == chrom && blocks[b + 1].pos <= dd.begin))
+    {
+      ++b;
+      continue;
     }
-    else
+
+    /// Decode the consecutive blocks that may have records in the region, starting without state like the encoder
+    std::size_t e{b + 1};
+
+    while (e < blocks.size() && blocks[e].contig == chrom && blocks[e].pos <= dd.end)
+      ++e;
+
+    DecodeData block_dd;
+    block_dd.options = options;
+    block_dd.drop_genotypes = dd.drop_genotypes;
+    block_dd.begin = dd.begin;
+    block_dd.end = dd.end;
+    dd = std::move(block_dd);
+    buffer_in.resize(0);
+
+    if (index.is_bgzf)
     {
-      auto ret_begin = std::from_chars(region.data() + colon + 1, region.data() + dash, begin);
+      uint64_t n_records{0};
 
-      if (ret_begin.ec != std::errc())
-        throw std::runtime_error("Could not parse region: " + region);
+      for (std::size_t i{b}; i < e; ++i)
+        n_records += blocks[i].n_records;
 
-      auto ret_end = std::from_chars(region.data() + dash + 1, region.data() + region.size(), end);
+      if (bgzf_seek(in_bgzf.get(), blocks[b].offset, SEEK_SET) < 0)
+      {
+        std::cerr << "[popvcf] ERROR: Could not seek in " << popvcf_fn << std::endl;
+        std::exit(1);
+      }
 
-      if (ret_end.ec != std::errc())
-        throw std::runtime_error("Could not parse region: " + region);
+      decode_lines(n_records);
+    }
+    else
+    {
+      decode_range(blocks[b].offset, e < blocks.size() ? blocks[e].offset : index.file_size);
+
+      /// Like tabix, a last record without a newline gets one
+      if (dd.in_size != 0)
+      {
+        buffer_in.push_back('\n');
+        decode_buffer</*in_region=*/true>(buffer_out, buffer_in, dd);
+        write_buffer_out();
+      }
     }
 
-    dd.begin = begin;
-    dd.end = end;
+    b = e;
   }
 
-  /// Determine the region to query
-  std::string safe_region = chrom;
-  long safe_begin;
+  free(str.s);
+
+  if (fd >= 0)
+    close(fd);
+}
+
+} // namespace
+
+void decode_region(std::string const & popvcf_fn, std::string const & region, bool const drop_genotypes)
+{
+  assert(region.size() > 0);
+  std::vector<char> buffer_in; // input buffer
+  buffer_in.reserve(DEC_BUFFER_SIZE);
+  std::vector<char> buffer_out; // output buffer
+  DecodeData dd;                // data used to keep track of buffers while decoding
+  dd.drop_genotypes = drop_genotypes;
+
+  /// parse region
+  std::string chrom;
+  long begin{-1};
+  long end{std::numeric_limits<long>::max()};
+  parse_region(region, chrom, begin, end);
 
   if (begin >= 0)
   {
-    safe_begin = std::max(1l, (begin / 10000l) * 10000l);
-    safe_region.push_back(':');
-    safe_region.append(std::to_string(std::max(1l, safe_begin)));
-    safe_region.push_back('-');
-    safe_region.append(std::to_string(end));
+    dd.begin = begin;
+    dd.end = end;
   }
-  else
+
+  /// Use the block index if there is one, plain popVCFs have no other index
+  BlockIndex block_index;
+
+  if (block_index.read(popvcf_fn + BLOCK_INDEX_SUFFIX))
   {
-    safe_begin = 0;
+    decode_indexed_region(popvcf_fn, block_index, chrom, dd);
+    return;
   }
 
+  /// Determine the region to query
+  long safe_begin{0};
+  std::string const safe_region = get_block_region(chrom, begin, end, safe_begin);
+
   /// Input streams
   popvcf::hts_file_ptr in_bgzf = popvcf::open_hts_file(popvcf_fn.c_str(), "r");            // open popvcf.gz
   popvcf::tbx_t_ptr in_tbx = popvcf::open_tbx_t(popvcf_fn.c_str());                        // open popvcf.gz.tbi
   popvcf::hts_itr_t_ptr in_it = popvcf::open_hts_itr_t(in_tbx.get(), safe_region.c_str()); // query region
 
-  /// Write the header lines
+  /// Write the header lines, which are decoded as well since they may describe the encoding
   kstring_t str = {0, 0, 0};
 
   while (hts_getline(in_bgzf.get(), KS_SEP_LINE, &str) >= 0)
@@ -154,10 +307,14 @@ void decode_region(std::string const & popvcf_fn, std::string const & region)
     if (!str.l || str.s[0] != in_tbx->conf.meta_char)
       break;
 
-    fwrite(str.s, 1, str.l, stdout);
-    fputs("\n", stdout);
+    buffer_in.insert(buffer_in.end(), str.s, str.s + str.l);
+    buffer_in.push_back('\n');
+    decode_buffer</*in_region=*/true>(buffer_out, buffer_in, dd);
   }
 
+  fwrite(buffer_out.data(), 1, buffer_out.size(), stdout);
+  buffer_out.resize(0);
+
   // return here, after writing header, if there are no records in the region
   if (in_it == nullptr)
   {
@@ -196,4 +353,200 @@ void decode_region(std::string const & popvcf_fn, std::string const & region)
   free(str.s);
 }
 
+namespace
+{
+long constexpr SEEK_GAP{BLOCK_SIZE}; //!< Minimum distance to the block of the next position to seek with the index
+
+//! Records to look up at one position
+class PositionQuery
+{
+public:
+  std::string chrom{};
+  long pos{-1};
+  std::vector<std::pair<std::string, std::string>> alleles{}; //!< REF and ALT to match, empty pairs match any record
+
+  //! True iff a record with \a ref and \a alt is queried
+  bool matches(std::string_view const ref, std::string_view const alt) const
+  {
+    for (auto const & [query_ref, query_alt] : alleles)
+    {
+      if (query_ref.empty() || (query_ref == ref && query_alt == alt))
+        return true;
+    }
+
+    return false;
+  }
+};
+
+//! Returns the column with index \a column_index (0 is CHROM) of a record.
+std::string_view get_column(std::string_view const record, long column_index)
+{
+  std::size_t b{0};
+
+  for (; column_index > 0 && b != std::string_view::npos; --column_index)
+  {
+    b = record.find('\t', b);
+    b = b == std::string_view::npos ? b : b + 1;
+  }
+
+  if (b == std::string_view::npos)
+    return std::string_view();
+
+  return record.substr(b, record.find('\t', b) - b);
+}
+
+//! Reads the next position of a positions file, merging lines with the same position. Returns false at the end.
+bool read_position_query(std::ifstream & in, std::string & line, bool & has_line, PositionQuery & query)
+{
+  query.alleles.resize(0);
+
+  while (has_line || std::getline(in, line))
+  {
+    has_line = false;
+
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::vector<std::string_view> const columns = split_string(line, '\t');
+    long pos{-1};
+
+    if (columns.size() < 2 ||
+        std::from_chars(columns[1].data(), columns[1].data() + columns[1].size(), pos).ec != std::errc())
+    {
+      throw std::runtime_error("Could not parse position: " + line);
+    }
+
+    if (!query.alleles.empty() && (columns[0] != query.chrom || pos != query.pos))
+    {
+      has_line = true; // the line is the next position
+      return true;
+    }
+
+    if (columns[0] == query.chrom && pos < query.pos)
+      throw std::runtime_error("Positions are not sorted: " + line);
+
+    query.chrom = columns[0];
+    query.pos = pos;
+
+    if (columns.size() >= 4)
+      query.alleles.emplace_back(columns[2], columns[3]);
+    else
+      query.alleles.emplace_back();
+  }
+
+  return !query.alleles.empty();
+}
+
+} // namespace
+
+void decode_positions(std::string const & popvcf_fn, std::string const & positions_fn, bool const drop_genotypes)
+{
+  std::vector<char> buffer_in;  // input buffer
+  std::vector<char> buffer_out; // output buffer
+  buffer_out.reserve(2 * DEC_BUFFER_SIZE);
+  DecodeData dd; // data used to keep track of buffers while decoding
+  dd.drop_genotypes = drop_genotypes;
+
+  std::ifstream positions_in(positions_fn);
+
+  if (!positions_in.is_open())
+  {
+    std::cerr << "[popvcf] ERROR: Could not open positions file " << positions_fn << std::endl;
+    std::exit(1);
+  }
+
+  /// Input streams
+  popvcf::hts_file_ptr in_bgzf = popvcf::open_hts_file(popvcf_fn.c_str(), "r"); // open popvcf.gz
+  popvcf::tbx_t_ptr in_tbx = popvcf::open_tbx_t(popvcf_fn.c_str());             // open popvcf.gz.tbi
+  popvcf::hts_itr_t_ptr in_it(nullptr, popvcf::close_hts_itr_t);
+
+  /// Write the header lines, which are decoded as well since they may describe the encoding
+  kstring_t str = {0, 0, 0};
+
+  while (hts_getline(in_bgzf.get(), KS_SEP_LINE, &str) >= 0)
+  {
+    if (!str.l || str.s[0] != in_tbx->conf.meta_char)
+      break;
+
+    buffer_in.insert(buffer_in.end(), str.s, str.s + str.l);
+    buffer_in.push_back('\n');
+    decode_buffer</*in_region=*/true>(buffer_out, buffer_in, dd);
+  }
+
+  fwrite(buffer_out.data(), 1, buffer_out.size(), stdout);
+  buffer_out.resize(0);
+
+  FormatOptions const options = dd.options;
+  std::string it_chrom{}; // contig of the iterator
+  bool has_record{false}; // true iff str has a record that has not been looked up yet
+  long record_pos{0};     // position of the record in str
+  long decoded_block{-1}; // block of the records that have been decoded
+  std::string line{};     // line of the positions file
+  bool has_line{false};   // true iff line has the next position
+  PositionQuery query{};  // the position to look up
+
+  while (read_position_query(positions_in, line, has_line, query))
+  {
+    long const query_block_begin = (query.pos / BLOCK_SIZE) * BLOCK_SIZE;
+
+    /// Seek with the index to the block of the position, unless it is near the records that are read
+    if (query.chrom != it_chrom || (has_record && query_block_begin - record_pos > SEEK_GAP))
+    {
+      std::string const region = query.chrom + ':' + std::to_string(std::max(1l, query_block_begin)) + '-';
+      in_it.reset(tbx_itr_querys(in_tbx.get(), region.c_str()));
+      it_chrom = query.chrom;
+      has_record = false;
+      decoded_block = -1;
+    }
+
+    while (in_it != nullptr && (has_record || tbx_itr_next(in_bgzf.get(), in_tbx.get(), in_it.get(), &str) > 0))
+    {
+      has_record = true;
+      record_pos = get_vcf_pos(str.s, str.s + str.l);
+
+      if (record_pos > query.pos)
+        break; // the record may be at a later position of the list
+
+      has_record = false;
+
+      if (record_pos < query_block_begin)
+        continue; // records of earlier blocks are not needed to decode this block
+
+      /// Records of a new block never refer to earlier records
+      if (record_pos / BLOCK_SIZE != decoded_block)
+      {
+        dd = DecodeData();
+        dd.options = options;
+        dd.drop_genotypes = drop_genotypes;
+        decoded_block = record_pos / BLOCK_SIZE;
+      }
+
+      /// Records before the position are decoded since later records may refer to them
+      dd.begin = query.pos;
+      dd.end = query.pos;
+      std::size_t const out_size = buffer_out.size();
+      buffer_in.assign(str.s, str.s + str.l);
+      buffer_in.push_back('\n');
+      decode_buffer</*in_region=*/true>(buffer_out, buffer_in, dd);
+
+      if (record_pos == query.pos)
+      {
+        std::string_view const record(str.s, str.l);
+
+        if (!query.matches(get_column(record, 3 /*REF*/), get_column(record, 4 /*ALT*/)))
+          buffer_out.resize(out_size);
+      }
+
+      if (buffer_out.size() >= DEC_BUFFER_SIZE)
+      {
+        fwrite(buffer_out.data(), 1, buffer_out.size(), stdout);
+        buffer_out.resize(0);
+      }
+    }
+  }
+
+  fwrite(buffer_out.data(), 1, buffer_out.size(), stdout);
+  free(str.s);
+}
+
 } // namespace popvcf
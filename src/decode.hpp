@@ -5,14 +5,20 @@
 #include <cassert>
 #include <charconv>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <parallel_hashmap/phmap.h>
 
+#include "format.hpp"
+#include "gather_output.hpp"
+#include "history.hpp"
 #include "sequence_utils.hpp"
+#include "site_columns.hpp"
 
 #include <popvcf/constants.hpp>
 
@@ -27,6 +33,19 @@ public:
   std::size_t i{b};       //!< Curent index in input buffer
   bool header_line{true}; //!< True iff in header line
   bool in_region{true};   //!< True iff in region
+  bool meta_line{false};  //!< True iff in a header line starting with "##"
+
+  /* Optional encoding features and decoding of site data only. */
+  FormatOptions options{};    //!< Features of the input, set when its options header line is read
+  bool drop_genotypes{false}; //!< True iff only the first eight columns are decoded
+  bool write_genotypes{true}; //!< False to only keep genotypes in unique_fields and field2uid, without writing them
+  bool is_frame_read{false};  //!< True iff the prefix of the genotypes of the current record has been read
+  bool has_checksum{false};   //!< True iff a checksum has been read, the reader of the checksum resets it
+  uint32_t checksum{0};       //!< CRC32 of the decoded block up to and including the record with the checksum
+  bool skip_line{false};      //!< True iff the rest of the current line is skipped
+  std::size_t skip{0};        //!< Number of bytes of the current record left to skip
+  bool is_packed_row{false};  //!< True iff the genotypes of the current record are packed
+  std::string packed_row{};   //!< Genotypes of the current packed record that have been read
 
   int64_t begin{-1};
   int64_t end{std::numeric_limits<int64_t>::max()};
@@ -41,13 +60,25 @@ public:
   std::vector<uint32_t> field2uid{};
   std::vector<std::string> unique_fields{};
   phmap::flat_hash_map<std::string, uint32_t> map_to_unique_fields{};
+  RowHistory history{}; //!< Earlier records, used with the allele_history option
+
+  /* Site columns of the previous record, used with the site_columns option. */
+  SiteColumns site_columns{};
+  std::string stored_column{}; //!< Start of a site column that continues in the next buffer
 
   inline void clear_line(int32_t next_n_alt)
   {
     next_n_alt += stored_alt;
     stored_alt = 0;
 
-    if (next_n_alt == n_alt)
+    if (options.allele_history)
+    {
+      /// The record refers to the previous record unless its genotypes start with a HISTORY_MARKER
+      history.give_back(*this);
+      history.push(*this);
+      history.lend(*this, 1);
+    }
+    else if (next_n_alt == n_alt)
     {
       std::swap(prev_field2uid, field2uid);
       std::swap(prev_unique_fields, unique_fields);
@@ -74,6 +105,204 @@ inline void set_input_size(Tdec_array_buf & /*buffer_in*/, DecodeData & /*dd*/)
   // NOTE: dd.in_size must be set prior to calling decode_buffer in arrays
 }
 
+//! Moves past genotypes that are not decoded, which may continue from the previous buffer.
+template <typename Tbuffer_in>
+inline void skip_genotypes(Tbuffer_in const & buffer_in, DecodeData & dd)
+{
+  if (dd.skip_line)
+  {
+    void const * newline = std::memchr(buffer_in.data() + dd.i, '\n', dd.in_size - dd.i);
+
+    if (newline == nullptr)
+    {
+      dd.i = dd.in_size;
+    }
+    else
+    {
+      dd.i = static_cast<char const *>(newline) - buffer_in.data() + 1;
+      dd.skip_line = false;
+    }
+  }
+  else
+  {
+    /// The length of framed genotypes is known
+    std::size_t const n = std::min(dd.skip, dd.in_size - dd.i);
+    dd.i += n;
+    dd.skip -= n;
+  }
+
+  dd.b = dd.i;
+
+  if (!dd.skip_line && dd.skip == 0)
+  {
+    dd.field = 0;
+    dd.is_frame_read = false;
+  }
+}
+
+//! Expands the genotypes of a packed record, which are in dd.packed_row without the final newline. The expansion of
+//! each packed character of three samples is looked up in a table that is built for the record.
+template <typename Tbuffer_out>
+inline void expand_packed_row(Tbuffer_out & buffer_out, DecodeData & dd, bool const is_genotype_written)
+{
+  std::size_t constexpr N_PACKED_VALUES{64};
+  std::size_t constexpr ENTRY_SIZE{16};    // capacity of a table entry
+  std::size_t constexpr MAX_FIELD_SIZE{4}; // fields that fit in a table entry with their delimiter
+
+  std::string_view const row(dd.packed_row);
+  std::size_t const first_tab = row.find('\t');
+  assert(first_tab != std::string_view::npos);
+  std::string_view const packed = row.substr(3, first_tab - 3);
+  uint32_t const n_last = row[1] - '0';
+  uint32_t const n_fields = row[2] - '0';
+  std::size_t token_begin{first_tab + 1};
+
+  auto next_token = [&]()
+  {
+    std::size_t token_end = row.find('\t', token_begin);
+    token_end = token_end == std::string_view::npos ? row.size() : token_end;
+    std::string_view const token = row.substr(token_begin, token_end - token_begin);
+    token_begin = token_end + 1;
+    return token;
+  };
+
+  auto add_unique_field = [&](std::string_view const field)
+  {
+    dd.map_to_unique_fields.insert(std::pair<std::string, uint32_t>(std::string(field), dd.unique_fields.size()));
+    dd.unique_fields.emplace_back(field);
+  };
+
+  bool is_table_valid{true};
+
+  for (uint32_t u{0}; u < n_fields; ++u)
+  {
+    add_unique_field(next_token());
+    is_table_valid &= dd.unique_fields.back().size() <= MAX_FIELD_SIZE;
+  }
+
+  /// Table of the expansions of packed characters without escapes
+  bool const is_table_used = is_genotype_written && is_table_valid;
+  std::array<std::array<char, ENTRY_SIZE>, N_PACKED_VALUES> entries;
+  std::array<uint8_t, N_PACKED_VALUES> entry_sizes{};
+  std::array<bool, N_PACKED_VALUES> is_plain{}; // true iff the states of the packed character are fields u_0..
+
+  for (uint32_t v{0}; v < N_PACKED_VALUES; ++v)
+  {
+    uint32_t const states[3] = {v & 3, (v >> 2) & 3, v >> 4};
+    is_plain[v] = states[0] < n_fields && states[1] < n_fields && states[2] < n_fields;
+
+    for (uint32_t s{0}; s < 3 && is_plain[v] && is_table_used; ++s)
+    {
+      std::string const & field = dd.unique_fields[states[s]];
+      std::copy(field.begin(), field.end(), entries[v].begin() + entry_sizes[v]);
+      entry_sizes[v] += field.size() + 1;
+      entries[v][entry_sizes[v] - 1] = '\t';
+    }
+  }
+
+  /// Expand the packed characters
+  std::size_t const n_samples = (packed.size() - 1) * 3 + n_last;
+  dd.field2uid.resize(n_samples);
+
+  for (std::size_t c{0}; c < packed.size(); ++c)
+  {
+    uint32_t const v = packed[c] - PACKED_CHAR_MIN;
+    std::size_t const s = 3 * c;
+
+    if (is_plain[v] && c + 1 < packed.size() && (is_table_used || !is_genotype_written))
+    {
+      dd.field2uid[s] = v & 3;
+      dd.field2uid[s + 1] = (v >> 2) & 3;
+      dd.field2uid[s + 2] = v >> 4;
+
+      if (is_genotype_written)
+        buffer_out.insert(buffer_out.end(), entries[v].data(), entries[v].data() + entry_sizes[v]);
+
+      continue;
+    }
+
+    std::size_t const n = c + 1 < packed.size() ? 3 : n_last;
+
+    for (std::size_t j{0}; j < n; ++j)
+    {
+      uint32_t uid = (v >> (2 * j)) & 3;
+
+      if (uid == PACKED_ESCAPE)
+      {
+        std::string_view const token = next_token();
+
+        if (token[0] >= CHAR_SET_MIN)
+        {
+          uid = ascii_cstring_to_int(token.data(), token.data() + token.size());
+        }
+        else
+        {
+          uid = dd.unique_fields.size();
+          add_unique_field(token);
+        }
+      }
+
+      assert(uid < dd.unique_fields.size());
+      dd.field2uid[s + j] = uid;
+
+      if (is_genotype_written)
+      {
+        std::string const & field = dd.unique_fields[uid];
+        buffer_out.insert(buffer_out.end(), field.begin(), field.end());
+        buffer_out.push_back('\t');
+      }
+    }
+  }
+
+  if (is_genotype_written)
+    buffer_out.back() = '\n'; // replaces the last tab
+
+  dd.packed_row.resize(0);
+  dd.is_packed_row = false;
+}
+
+//! Appends a range of the input buffer, of the previous record or of a seed to \a buffer_out. These stay valid until
+//! release_refs() is called.
+template <typename Tbuffer_out>
+inline void append_ref(Tbuffer_out & buffer_out, char const * first, char const * last)
+{
+  buffer_out.insert(buffer_out.end(), first, last);
+}
+
+//! GatherOutput refers to long ranges instead of copying them.
+inline void append_ref(GatherOutput & buffer_out, char const * first, char const * last)
+{
+  buffer_out.append_ref(first, last);
+}
+
+//! Called before the ranges appended with append_ref() may change.
+template <typename Tbuffer_out>
+inline void release_refs(Tbuffer_out & /*buffer_out*/)
+{
+}
+
+inline void release_refs(GatherOutput & buffer_out)
+{
+  buffer_out.release_refs();
+}
+
+//! Decodes a site column that ends at dd.i, which was encoded against the same column of the previous record.
+template <typename Tbuffer_in>
+inline std::string const & decode_site_column(Tbuffer_in const & buffer_in, DecodeData & dd)
+{
+  std::string_view column(&buffer_in[dd.b], dd.i - dd.b);
+
+  if (!dd.stored_column.empty())
+  {
+    dd.stored_column.append(column);
+    column = dd.stored_column;
+  }
+
+  std::string const & decoded = dd.site_columns.decode(dd.field, column);
+  dd.stored_column.resize(0);
+  return decoded;
+}
+
 //! Decodes an input buffer. Output is written in \a buffer_out .
 template <bool is_region, typename Tbuffer_out, typename Tbuffer_in>
 inline void decode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, DecodeData & dd)
@@ -81,6 +310,9 @@ inline void decode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Deco
   set_input_size(buffer_in, dd);
   std::size_t constexpr N_FIELDS_SITE_DATA{9};
 
+  if (dd.skip_line || dd.skip > 0)
+    skip_genotypes(buffer_in, dd);
+
   // inner loop - Loops over each character in the input buffer
   while (dd.i < dd.in_size)
   {
@@ -95,6 +327,21 @@ inline void decode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Deco
     if (dd.field == 0)
     {
       dd.header_line = buffer_in[dd.b] == '#'; // check if in header line
+      dd.meta_line = dd.header_line && (dd.i - dd.b) > 1 && buffer_in[dd.b + 1] == '#';
+
+      if (dd.meta_line && b_in == '\n')
+      {
+        std::string_view const line(&buffer_in[dd.b], dd.i - dd.b);
+
+        if (line.substr(0, POPVCF_HEADER_PREFIX.size()) == POPVCF_HEADER_PREFIX)
+        {
+          /// Header lines describing the encoding are not part of the decoded VCF
+          dd.options.parse_header_line(line);
+          ++dd.i;
+          dd.b = dd.i;
+          continue;
+        }
+      }
 
       if (not dd.header_line)
       {
@@ -121,11 +368,58 @@ inline void decode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Deco
       else if (dd.field == 4) /* ALT field */
       {
         int32_t next_n_alt = std::count(&buffer_in[dd.b], &buffer_in[dd.i], ',');
+        release_refs(buffer_out); // fields of the previous record are cleared
         dd.clear_line(next_n_alt);
       }
     }
 
-    if (dd.header_line || dd.field < N_FIELDS_SITE_DATA)
+    if (dd.drop_genotypes && !dd.meta_line && (dd.field == 7 /*INFO*/ || dd.field == 8 /*FORMAT*/))
+    {
+      /// Only the first eight columns are decoded, INFO ends the line
+      std::string_view column(&buffer_in[dd.b], dd.i - dd.b);
+
+      if (!dd.header_line && dd.options.site_columns)
+        column = decode_site_column(buffer_in, dd);
+
+      if (dd.field == 7 && (!is_region || dd.in_region))
+      {
+        buffer_out.insert(buffer_out.end(), column.begin(), column.end());
+        buffer_out.push_back('\n');
+      }
+
+      ++dd.i;
+      dd.b = dd.i;
+
+      if (b_in == '\n')
+      {
+        dd.field = 0;
+      }
+      else if (!dd.header_line && dd.options.framed)
+      {
+        ++dd.field; // the length of the genotypes follows FORMAT
+      }
+      else
+      {
+        dd.skip_line = true;
+        skip_genotypes(buffer_in, dd);
+      }
+
+      continue;
+    }
+
+    if (!dd.header_line && dd.options.site_columns && is_coded_site_column(dd.field))
+    {
+      std::string const & column = decode_site_column(buffer_in, dd);
+
+      if (!is_region || dd.in_region)
+      {
+        buffer_out.insert(buffer_out.end(), column.begin(), column.end());
+        buffer_out.push_back(b_in);
+      }
+
+      ++dd.i;
+    }
+    else if (dd.header_line || dd.field < N_FIELDS_SITE_DATA)
     {
       // write field without any encoding
       ++dd.i; // adds '\t' or '\n'
@@ -133,10 +427,66 @@ inline void decode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Deco
       if (!is_region || dd.in_region)
         buffer_out.insert(buffer_out.end(), &buffer_in[dd.b], &buffer_in[dd.i]);
     }
+    else if (dd.options.has_record_prefix() && !dd.is_frame_read)
+    {
+      /// Prefix of the genotypes of the record. Their length is only needed when they are skipped
+      char const * token = &buffer_in[dd.b];
+      char const * const prefix_end = &buffer_in[dd.i];
+      uint32_t frame_size{0};
+
+      if (dd.options.framed)
+      {
+        char const * const comma = std::find(token, prefix_end, ',');
+        frame_size = ascii_cstring_to_int(token, comma);
+        token = comma + 1;
+      }
+
+      if (dd.options.checksum)
+      {
+        dd.checksum = ascii_cstring_to_int(token, prefix_end);
+        dd.has_checksum = true;
+      }
+
+      ++dd.i;
+      dd.b = dd.i;
+      dd.is_frame_read = true;
+
+      if (dd.drop_genotypes)
+      {
+        dd.skip = frame_size;
+        skip_genotypes(buffer_in, dd);
+      }
+
+      continue;
+    }
+    else if (dd.field == N_FIELDS_SITE_DATA && buffer_in[dd.b] == HISTORY_MARKER && dd.field2uid.empty())
+    {
+      /// The record refers to an earlier record than the previous one
+      uint32_t const history_back = ascii_cstring_to_int(&buffer_in[dd.b + 1], &buffer_in[dd.i]);
+      dd.history.give_back(dd);
+      dd.history.lend(dd, history_back);
+      ++dd.i;
+      dd.b = dd.i;
+      continue;
+    }
+    else if (dd.is_packed_row || (dd.field == N_FIELDS_SITE_DATA && buffer_in[dd.b] == PACKED_ROW_MARKER))
+    {
+      /// Packed genotypes are expanded when the whole record has been read
+      if (dd.is_packed_row)
+        dd.packed_row.push_back('\t');
+
+      dd.packed_row.append(&buffer_in[dd.b], dd.i - dd.b);
+      dd.is_packed_row = true;
+      ++dd.i;
+
+      if (b_in == '\n')
+        expand_packed_row(buffer_out, dd, (!is_region || dd.in_region) && dd.write_genotypes);
+    }
     else
     {
       long field_idx = dd.field - N_FIELDS_SITE_DATA;
       assert(field_idx == static_cast<long>(dd.field2uid.size()));
+      bool const is_genotype_written = (!is_region || dd.in_region) && dd.write_genotypes;
 
       while (buffer_in[dd.b] == '$' || buffer_in[dd.b] == '&')
       {
@@ -166,9 +516,9 @@ inline void decode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Deco
         ++dd.field;
         ++field_idx;
 
-        if (!is_region || dd.in_region)
+        if (is_genotype_written)
         {
-          buffer_out.insert(buffer_out.end(), prior_field.begin(), prior_field.end());
+          append_ref(buffer_out, prior_field.data(), prior_field.data() + prior_field.size());
 
           if (dd.b < dd.i)
             buffer_out.push_back('\t');
@@ -177,7 +527,7 @@ inline void decode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Deco
 
       if (buffer_in[dd.b] == '\n')
       {
-        if (!is_region || dd.in_region)
+        if (is_genotype_written)
           buffer_out.push_back('\n');
 
         ++dd.i;
@@ -194,9 +544,27 @@ inline void decode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Deco
         dd.field2uid.push_back(dd.unique_fields.size());
         dd.unique_fields.push_back(prior_field);
 
-        if (!is_region || dd.in_region)
+        if (is_genotype_written)
         {
-          buffer_out.insert(buffer_out.end(), prior_field.begin(), prior_field.end());
+          append_ref(buffer_out, prior_field.data(), prior_field.data() + prior_field.size());
+          buffer_out.push_back(b_in);
+        }
+      }
+      else if (buffer_in[dd.b] == SEED_MARKER)
+      {
+        // Unique field within the line that is a seed
+        ++dd.b; // Get over the seed marker
+        uint32_t const seed_index = ascii_cstring_to_int(&buffer_in[dd.b], &buffer_in[dd.i++]);
+        assert(seed_index < dd.options.seeds.size());
+        std::string const & seed = dd.options.seeds[seed_index];
+
+        dd.map_to_unique_fields.insert(std::pair<std::string, uint32_t>(seed, dd.unique_fields.size()));
+        dd.field2uid.push_back(dd.unique_fields.size());
+        dd.unique_fields.push_back(seed);
+
+        if (is_genotype_written)
+        {
+          append_ref(buffer_out, seed.data(), seed.data() + seed.size());
           buffer_out.push_back(b_in);
         }
       }
@@ -208,7 +576,7 @@ inline void decode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Deco
         dd.field2uid.push_back(unique_index);
         std::string const & prior_field = dd.unique_fields[unique_index];
 
-        if (!is_region || dd.in_region)
+        if (is_genotype_written)
         {
           buffer_out.insert(buffer_out.end(), prior_field.begin(), prior_field.end());
           buffer_out.push_back(b_in);
@@ -227,8 +595,8 @@ inline void decode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Deco
         dd.unique_fields.push_back(insert_it.first->first);
         ++dd.i;
 
-        if (!is_region || dd.in_region)
-          buffer_out.insert(buffer_out.end(), &buffer_in[dd.b], &buffer_in[dd.i]);
+        if (is_genotype_written)
+          append_ref(buffer_out, &buffer_in[dd.b], &buffer_in[dd.i]);
       }
 
       // assert((field_idx + 1) == static_cast<long>(dd.field2uid.size()));
@@ -238,15 +606,24 @@ inline void decode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Deco
     dd.b = dd.i;
 
     if (b_in == '\n')
+    {
       dd.field = 0;
+      dd.is_frame_read = false;
+    }
     else
+    {
       ++dd.field;
+    }
   } // ends inner loop
 
+  release_refs(buffer_out); // the input buffer is moved
+
   if (dd.field >= 3 && dd.field < N_FIELDS_SITE_DATA)
   {
-    // write field without updating the field index
-    if (!is_region || dd.in_region)
+    // write field without updating the field index, unless it is decoded when it is complete
+    if (!dd.header_line && dd.options.site_columns && is_coded_site_column(dd.field))
+      dd.stored_column.append(&buffer_in[dd.b], dd.i - dd.b);
+    else if ((!is_region || dd.in_region) && !(dd.drop_genotypes && dd.field == 8 /*FORMAT*/))
       buffer_out.insert(buffer_out.end(), &buffer_in[dd.b], &buffer_in[dd.i]);
 
     if (dd.field == 4) /*store the number of ALT alleles if we are in the ALT field*/
@@ -266,10 +643,21 @@ inline void decode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Deco
   resize_input_buffer(buffer_in, dd.i);
 }
 
-//! Decode an encoded popVCF
-void decode_file(std::string const & popvcf_fn, bool const is_bgzf_input);
-
-//! Decode a region with a bgzf file and tabix index.
-void decode_region(std::string const & popvcf_fn, std::string const & region);
+//! Decode an encoded popVCF. With \a drop_genotypes only the first eight columns are written. With \a is_writev the
+//! output is written with writev() by the decoding thread, which refers to long genotype fields instead of copying
+//! them.
+void decode_file(std::string const & popvcf_fn,
+                 bool const is_bgzf_input,
+                 bool const drop_genotypes,
+                 bool const is_writev);
+
+//! Decode a region with the block index (.pvi) of a plain or bgzipped popVCF, or else with a bgzf file and tabix index.
+void decode_region(std::string const & popvcf_fn, std::string const & region, bool const drop_genotypes);
+
+//! Decode the records at the positions listed in \a positions_fn with a bgzf file and tabix index. Each line of the
+//! list has a contig and a position, optionally followed by REF and ALT which the records must match. Positions must
+//! be sorted within each contig. The file is read in a single pass, which only seeks ahead with the index when the
+//! next position is at least a block away.
+void decode_positions(std::string const & popvcf_fn, std::string const & positions_fn, bool const drop_genotypes);
 
 } // namespace popvcf
@@ -1,17 +1,37 @@
 #include "encode.hpp"
 
-#include <array> // std::array
+#include <algorithm> // std::sort, std::min
+#include <array>     // std::array
 #include <charconv>
-#include <iostream> // std::cerr
-#include <string>   // std::string
+#include <cstdio>      // std::remove, fseeko
+#include <cstdlib>     // std::exit, free
+#include <deque>       // std::deque
+#include <fstream>     // std::ifstream
+#include <iostream>    // std::cerr
+#include <memory>      // std::unique_ptr
+#include <mutex>       // std::mutex, std::lock_guard
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
 #include <zlib.h>
 
-#include <parallel_hashmap/phmap.h> // phmap::flat_hash_map
+#include <fcntl.h>    // open
+#include <sys/stat.h> // stat
+#include <unistd.h>   // close, fsync, truncate
 
+#include <parallel_hashmap/phmap.h> // phmap::flat_hash_map, phmap::flat_hash_set
+
+#include "checkpoint.hpp"
 #include "io.hpp"
+#include "pipeline.hpp"
+#include "row_encoder.hpp"
 #include "sequence_utils.hpp" // int_to_ascii
+#include "shadow_decoder.hpp"
+#include "zone_map.hpp"
 
 #include "htslib/bgzf.h"
+#include "htslib/hfile.h"
+#include "htslib/kstring.h"
 
 class BGZF;
 
@@ -22,11 +42,63 @@ void encode_file(std::string const & input_fn,
                  std::string const & output_fn,
                  std::string const & output_mode,
                  bool const is_bgzf_output,
-                 int const compression_threads)
+                 int const compression_threads,
+                 int const row_threads,
+                 bool const write_zone_map,
+                 FormatOptions const & options,
+                 uint64_t const checkpoint_interval,
+                 bool const is_resume,
+                 bool const is_verify)
 {
-  Tenc_array_buf buffer_in;     // input buffer
-  std::vector<char> buffer_out; // output buffer
-  EncodeData ed;                // encode data struct
+  std::vector<char> buffer_in; // input data that has not been encoded yet
+  EncodeData ed;               // encode data struct
+  ZoneMap zone_map;            // summary of each block of the output
+  ed.set_options(options);
+
+  if (write_zone_map)
+    ed.zone_map = &zone_map;
+
+  /// Continue an interrupted encoding from its checkpoint, the output after it is discarded
+  std::string const checkpoint_fn = output_fn + CHECKPOINT_SUFFIX;
+  Checkpoint resumed; // checkpoint that the encoding continues from, the start of the input if not resuming
+  resumed.options_checksum = Checkpoint::get_options_checksum(options);
+  resumed.is_bgzf_output = is_bgzf_output;
+  std::string mode = output_mode;
+
+  if (is_resume)
+  {
+    if (!resumed.read(checkpoint_fn))
+    {
+      std::cerr << "[popvcf] ERROR: Could not open checkpoint " << checkpoint_fn << std::endl;
+      std::exit(1);
+    }
+
+    if (resumed.options_checksum != Checkpoint::get_options_checksum(options) ||
+        resumed.is_bgzf_output != is_bgzf_output)
+    {
+      std::cerr << "[popvcf] ERROR: " << output_fn << " was encoded with other options or another output type."
+                << std::endl;
+      std::exit(1);
+    }
+
+    struct stat output_stat;
+
+    if (stat(output_fn.c_str(), &output_stat) != 0 ||
+        static_cast<uint64_t>(output_stat.st_size) < resumed.file_offset ||
+        truncate(output_fn.c_str(), resumed.file_offset) != 0)
+    {
+      std::cerr << "[popvcf] ERROR: Could not truncate " << output_fn << " to its checkpoint at "
+                << resumed.file_offset << " bytes." << std::endl;
+      std::exit(1);
+    }
+
+    mode[0] = 'a';                // append to the output up to the checkpoint
+    ed.is_options_written = true; // the header is not encoded again
+  }
+  else if (checkpoint_interval > 0)
+  {
+    std::remove(checkpoint_fn.c_str()); // a checkpoint of an earlier encoding does not apply to the new output
+  }
 
   /// Open input file streams
   popvcf::bgzf_ptr in_bgzf(nullptr, popvcf::close_bgzf);   // bgzf input stream
@@ -37,64 +109,509 @@ void encode_file(std::string const & input_fn,
   else
     in_vcf = popvcf::open_vcf(input_fn, "r");
 
+  auto read_input = [&](char * data, std::size_t const max_size) -> std::size_t
+  {
+    if (is_bgzf_input)
+      return popvcf::read_bgzf(in_bgzf.get(), data, max_size);
+    else
+      return fread(data, 1, max_size, in_vcf.get());
+  };
+
+  if (resumed.in_offset > 0 && !is_bgzf_input && input_fn != "-")
+  {
+    if (fseeko(in_vcf.get(), resumed.in_offset, SEEK_SET) != 0)
+    {
+      std::cerr << "[popvcf] ERROR: Could not seek to the checkpoint in " << input_fn << std::endl;
+      std::exit(1);
+    }
+  }
+  else if (resumed.in_offset > 0)
+  {
+    /// Compressed input and standard input are read up to the checkpoint
+    std::vector<char> skipped(ENC_BUFFER_SIZE);
+
+    for (uint64_t n_skipped{0}; n_skipped < resumed.in_offset;)
+    {
+      uint64_t const max_size = std::min<uint64_t>(skipped.size(), resumed.in_offset - n_skipped);
+      std::size_t const size = read_input(skipped.data(), max_size);
+
+      if (size == 0)
+      {
+        std::cerr << "[popvcf] ERROR: " << input_fn << " ends before its checkpoint." << std::endl;
+        std::exit(1);
+      }
+
+      n_skipped += size;
+    }
+  }
+
   /// Open output file streams
   popvcf::bgzf_ptr out_bgzf(nullptr, popvcf::close_bgzf);   // bgzf output stream
   popvcf::file_ptr out_vcf(nullptr, popvcf::close_vcf_nop); // vcf output stream
 
   if (is_bgzf_output)
   {
-    out_bgzf = popvcf::open_bgzf(output_fn.c_str(), output_mode.c_str());
+    out_bgzf = popvcf::open_bgzf(output_fn.c_str(), mode.c_str());
 
     if (compression_threads > 1)
       bgzf_mt(out_bgzf.get(), compression_threads, 256);
+
+    /// Blocks in the zone map are found by their uncompressed offsets with a .gzi index
+    if (write_zone_map && bgzf_index_build_init(out_bgzf.get()) < 0)
+    {
+      std::cerr << "[popvcf] ERROR: Could not start the .gzi index of " << output_fn << std::endl;
+      std::exit(1);
+    }
   }
   else
   {
-    out_vcf = popvcf::open_vcf(output_fn, output_mode);
+    out_vcf = popvcf::open_vcf(output_fn, mode);
   }
 
-  /// Read first buffer of input data
-  if (is_bgzf_input)
-    ed.in_size = bgzf_read(in_bgzf.get(), buffer_in.data(), ENC_BUFFER_SIZE);
-  else
-    ed.in_size = fread(buffer_in.data(), 1, ENC_BUFFER_SIZE, in_vcf.get());
+  buffer_in.reserve(2 * ENC_BUFFER_SIZE);
+  std::unique_ptr<RowEncoder> row_encoder;
+
+  if (row_threads > 1)
+    row_encoder = std::make_unique<RowEncoder>(row_threads);
 
-  long new_bytes = ed.in_size;
+  std::unique_ptr<ShadowDecoder> shadow_decoder; // decodes the output while encoding with is_verify
 
-  // loop until all data has been read
-  while (new_bytes != 0)
+  if (is_verify)
+    shadow_decoder = std::make_unique<ShadowDecoder>(options);
+
+  uint64_t n_read{resumed.in_offset};     // bytes of input that have been read
+  uint64_t n_encoded{resumed.out_offset}; // bytes of output that have been encoded
+  uint64_t n_written{resumed.out_offset}; // bytes of output that have been written
+
+  /// Checkpoints are taken at the first record of a block after every checkpoint_interval bytes of input. They are
+  /// saved by the writer once the output before them is written.
+  BlockStartFinder block_start_finder;
+  uint64_t next_checkpoint_in{resumed.in_offset + checkpoint_interval};
+  std::deque<Checkpoint> checkpoints; // checkpoints whose output has not been written yet
+  std::mutex checkpoints_mutex;
+  int64_t const file_tell_begin = is_bgzf_output ? (bgzf_tell(out_bgzf.get()) >> 16) : 0;
+
+  auto encode_data = [&](char const * data, std::size_t const size, std::vector<char> & buffer_out)
   {
-    // encode the input buffer and write to output buffer
-    encode_buffer(buffer_out, buffer_in, ed);
+    // encode the new input, data of the last field that is not complete is kept in buffer_in
+    buffer_in.insert(buffer_in.end(), data, data + size);
 
-    // write output buffer
-    if (out_bgzf != nullptr)
-      popvcf::write_bgzf(out_bgzf.get(), buffer_out.data(), buffer_out.size());
+    if (row_encoder)
+      row_encoder->encode_lines(buffer_out, buffer_in, ed); // only complete lines are encoded
     else
-      fwrite(buffer_out.data(), 1, buffer_out.size(), out_vcf.get()); // write output buffer
+      encode_buffer(buffer_out, buffer_in, ed);
+  };
 
-    buffer_out.resize(0);
-    new_bytes = -static_cast<long>(ed.in_size);
+  auto save_checkpoint = [&](Checkpoint & checkpoint)
+  {
+    bool is_flushed{false};
 
-    // attempt to read more data from input
-    if (is_bgzf_input)
-      ed.in_size += bgzf_read(in_bgzf.get(), buffer_in.data() + ed.in_size, ENC_BUFFER_SIZE - ed.in_size);
+    if (is_bgzf_output)
+    {
+      /// A BGZF block ends at the checkpoint so that the output is truncated there when resuming
+      is_flushed = bgzf_flush(out_bgzf.get()) == 0 && hflush(out_bgzf->fp) == 0;
+      checkpoint.file_offset = resumed.file_offset + (bgzf_tell(out_bgzf.get()) >> 16) - file_tell_begin;
+    }
     else
-      ed.in_size += fread(buffer_in.data() + ed.in_size, 1, ENC_BUFFER_SIZE - ed.in_size, in_vcf.get());
+    {
+      is_flushed = fflush(out_vcf.get()) == 0;
+      checkpoint.file_offset = checkpoint.out_offset;
+    }
+
+    /// The output up to the checkpoint must be in the file before the checkpoint replaces the previous one
+    int const fd = is_flushed ? open(output_fn.c_str(), O_RDONLY) : -1;
+
+    if (fd < 0 || fsync(fd) != 0)
+    {
+      std::cerr << "[popvcf] ERROR: Could not flush " << output_fn << std::endl;
+      std::exit(1);
+    }
+
+    close(fd);
+    checkpoint.write(checkpoint_fn);
+  };
+
+  /// Reading, encoding and writing run in separate threads
+  popvcf::run_pipeline(
+    ENC_BUFFER_SIZE,
+    read_input,
+    [&](char const * data, std::size_t const size, std::vector<char> & buffer_out)
+    {
+      ed.out_offset = n_encoded; // offset of buffer_out in the output
+
+      if (size > 0)
+      {
+        std::size_t const split = checkpoint_interval == 0
+                                    ? std::string::npos
+                                    : block_start_finder.find(data, size, n_read, next_checkpoint_in);
+
+        if (split == std::string::npos)
+        {
+          encode_data(data, size, buffer_out);
+        }
+        else
+        {
+          /// Encode up to the record that begins a block, where the encoder has no state
+          encode_data(data, split, buffer_out);
+          assert(buffer_in.empty());
+
+          Checkpoint checkpoint = resumed;
+          checkpoint.in_offset = n_read + split;
+          checkpoint.out_offset = n_encoded + buffer_out.size();
+          next_checkpoint_in = checkpoint.in_offset + checkpoint_interval;
+
+          {
+            std::lock_guard<std::mutex> lock(checkpoints_mutex);
+            checkpoints.push_back(checkpoint);
+          }
+
+          encode_data(data + split, size - split, buffer_out);
+        }
+
+        n_read += size;
+      }
+      else
+      {
+        // the row encoder keeps the last line if it has no newline
+        if (row_encoder && !buffer_in.empty())
+          encode_buffer(buffer_out, buffer_in, ed);
+
+        if (ed.in_size != 0)
+        {
+          std::cerr << "[popvcf] WARNING: Unexpected ending of the VCF data, possibly the file is truncated.\n";
+          buffer_out.insert(buffer_out.end(), buffer_in.begin(), buffer_in.end());
+        }
+      }
+
+      n_encoded += buffer_out.size();
+
+      if (shadow_decoder)
+        shadow_decoder->add(data, size, buffer_out.data(), buffer_out.size());
+    },
+    [&](char const * data, std::size_t const size)
+    {
+      std::size_t b{0}; // begin of the data that has not been written
+
+      while (true)
+      {
+        Checkpoint checkpoint;
+
+        {
+          std::lock_guard<std::mutex> lock(checkpoints_mutex);
+
+          if (checkpoints.empty() || checkpoints.front().out_offset > n_written + size - b)
+            break;
+
+          checkpoint = checkpoints.front();
+          checkpoints.pop_front();
+        }
+
+        std::size_t const e = b + (checkpoint.out_offset - n_written);
+        popvcf::write_output(out_bgzf.get(), out_vcf.get(), data + b, e - b);
+        n_written += e - b;
+        b = e;
+        save_checkpoint(checkpoint);
+      }
+
+      popvcf::write_output(out_bgzf.get(), out_vcf.get(), data + b, size - b);
+      n_written += size - b;
+    });
+
+  if (shadow_decoder)
+  {
+    shadow_decoder->finish();
+    std::cerr << "[popvcf] Verified that the output decodes to the input." << std::endl;
+  }
+
+  if (write_zone_map)
+  {
+    if (is_bgzf_output && bgzf_index_dump(out_bgzf.get(), output_fn.c_str(), ".gzi") < 0)
+    {
+      std::cerr << "[popvcf] ERROR: Could not write the .gzi index of " << output_fn << std::endl;
+      std::exit(1);
+    }
+
+    /// The zone map is only valid for the output as it is now, which is closed to know its final size
+    out_bgzf.reset();
+    out_vcf.reset();
+    zone_map.file_size = get_file_size(output_fn);
+    zone_map.file_mtime = get_file_mtime(output_fn);
+    zone_map.write(output_fn + ZONE_MAP_SUFFIX);
+  }
+}
+
+namespace
+{
+//! Returns the index of the first genotype field of a VCF line, or npos if it has no genotype fields.
+std::size_t find_genotypes(std::string_view const line)
+{
+  std::size_t b{0};
+
+  for (int f{0}; f < 9 && b != std::string_view::npos; ++f)
+  {
+    b = line.find('\t', b);
+    b = b == std::string_view::npos ? b : b + 1;
+  }
+
+  return b;
+}
+
+//! Returns the sites of a record, which must be the same in all pasted files: CHROM, POS, REF, ALT and FORMAT.
+std::array<std::string_view, 5> get_paste_sites(std::string_view const line, std::size_t const genotypes_begin)
+{
+  std::vector<std::string_view> const columns = split_string(line.substr(0, genotypes_begin - 1), '\t');
+  assert(columns.size() == 9);
+  return {columns[0], columns[1], columns[3], columns[4], columns[8]};
+}
+
+[[noreturn]] void paste_error(std::string const & message)
+{
+  std::cerr << "[popvcf] ERROR: " << message << std::endl;
+  std::exit(1);
+}
+
+} // namespace
+
+std::vector<std::string> learn_seeds(std::string const & input_fn)
+{
+  long constexpr N_SAMPLED_RECORDS{1000}; // records that the seeds are learned from
+
+  popvcf::bgzf_ptr in_bgzf = popvcf::open_bgzf(input_fn, "r"); // bgzf also reads files that are not compressed
+  kstring_t str{0, 0, nullptr};
+  phmap::flat_hash_map<std::string, long> n_records_with; // number of records that have each genotype field
+  phmap::flat_hash_set<std::string_view> record_fields;
+  long n_records{0};
 
-    new_bytes += ed.in_size;
+  while (n_records < N_SAMPLED_RECORDS && bgzf_getline(in_bgzf.get(), '\n', &str) >= 0)
+  {
+    std::string_view const line(str.s, str.l);
+    std::size_t const genotypes_begin = find_genotypes(line);
+
+    if (line.empty() || line[0] == '#' || genotypes_begin == std::string_view::npos)
+      continue;
+
+    ++n_records;
+    record_fields.clear();
+
+    for (std::string_view const field : split_string(line.substr(genotypes_begin), '\t'))
+    {
+      if (record_fields.insert(field).second)
+        ++n_records_with[std::string(field)];
+    }
   }
 
-  if (ed.in_size != 0)
+  free(str.s);
+
+  /// The seeds are the fields in the most records, if they are in at least 1% of them
+  std::vector<std::pair<long, std::string>> candidates;
+
+  for (auto const & field_count : n_records_with)
+  {
+    if (field_count.second > 1 && 100 * field_count.second >= n_records)
+      candidates.emplace_back(-field_count.second, field_count.first);
+  }
+
+  std::sort(candidates.begin(), candidates.end());
+  std::vector<std::string> seeds;
+
+  for (std::size_t c{0}; c < candidates.size() && c < MAX_SEEDS; ++c)
+    seeds.push_back(std::move(candidates[c].second));
+
+  return seeds;
+}
+
+std::vector<std::string> read_seeds(std::string const & seeds_fn)
+{
+  std::ifstream in(seeds_fn);
+
+  if (!in.is_open())
+  {
+    std::cerr << "[popvcf] ERROR: Could not open seeds file " << seeds_fn << std::endl;
+    std::exit(1);
+  }
+
+  std::vector<std::string> seeds;
+  std::string line;
+
+  while (std::getline(in, line))
+  {
+    if (line.empty())
+      continue;
+
+    if (line.find('\t') != std::string::npos)
+    {
+      std::cerr << "[popvcf] ERROR: A seed cannot have a tab: " << line << std::endl;
+      std::exit(1);
+    }
+
+    seeds.push_back(line);
+  }
+
+  if (seeds.size() > MAX_SEEDS)
+  {
+    std::cerr << "[popvcf] ERROR: " << seeds_fn << " has " << seeds.size() << " seeds but at most " << MAX_SEEDS
+              << " are allowed." << std::endl;
+    std::exit(1);
+  }
+
+  return seeds;
+}
+
+void encode_paste(std::vector<std::string> const & input_fns,
+                  std::string const & output_fn,
+                  std::string const & output_mode,
+                  bool const is_bgzf_output,
+                  int const compression_threads,
+                  int const row_threads,
+                  FormatOptions const & options)
+{
+  assert(input_fns.size() > 0);
+  std::size_t const n_inputs = input_fns.size();
+  std::vector<char> buffer_in;  // pasted lines that have not been encoded yet
+  std::vector<char> buffer_out; // encoded lines
+  EncodeData ed;                // encode data struct
+  ed.set_options(options);
+
+  /// Open input file streams, bgzf also reads files that are not compressed
+  std::vector<popvcf::bgzf_ptr> inputs;
+  std::vector<kstring_t> lines(n_inputs, kstring_t{0, 0, nullptr});
+
+  for (std::string const & input_fn : input_fns)
+    inputs.push_back(popvcf::open_bgzf(input_fn, "r"));
+
+  /// Open output file streams
+  popvcf::bgzf_ptr out_bgzf(nullptr, popvcf::close_bgzf);   // bgzf output stream
+  popvcf::file_ptr out_vcf(nullptr, popvcf::close_vcf_nop); // vcf output stream
+
+  if (is_bgzf_output)
+  {
+    out_bgzf = popvcf::open_bgzf(output_fn.c_str(), output_mode.c_str());
+
+    if (compression_threads > 1)
+      bgzf_mt(out_bgzf.get(), compression_threads, 256);
+  }
+  else
   {
-    std::cerr << "[popvcf] WARNING: Unexpected ending of the VCF data, possibly the file is truncated.\n";
+    out_vcf = popvcf::open_vcf(output_fn, output_mode);
+  }
+
+  std::unique_ptr<RowEncoder> row_encoder;
+
+  if (row_threads > 1)
+    row_encoder = std::make_unique<RowEncoder>(row_threads);
 
-    // write output buffer
-    if (out_bgzf != nullptr)
-      popvcf::write_bgzf(out_bgzf.get(), buffer_in.data(), ed.in_size);
+  auto encode_and_write = [&]()
+  {
+    if (row_encoder)
+      row_encoder->encode_lines(buffer_out, buffer_in, ed);
     else
-      fwrite(buffer_in.data(), 1, ed.in_size, out_vcf.get()); // write output buffer
+      encode_buffer(buffer_out, buffer_in, ed);
+
+    popvcf::write_output(out_bgzf.get(), out_vcf.get(), buffer_out.data(), buffer_out.size());
+    buffer_out.resize(0);
+  };
+
+  /// The header is the header of the first file, with the samples of all files on the "#CHROM" line
+  phmap::flat_hash_set<std::string> sample_names;
+
+  for (std::size_t i{0}; i < n_inputs; ++i)
+  {
+    kstring_t & str = lines[i];
+    bool is_chrom_line{false};
+
+    while (!is_chrom_line && bgzf_getline(inputs[i].get(), '\n', &str) >= 0)
+    {
+      std::string_view const line(str.s, str.l);
+      is_chrom_line = line.substr(0, 6) == "#CHROM";
+
+      if (!is_chrom_line)
+      {
+        if (line.empty() || line[0] != '#')
+          break;
+
+        if (i == 0)
+        {
+          buffer_in.insert(buffer_in.end(), line.begin(), line.end());
+          buffer_in.push_back('\n');
+        }
+
+        continue;
+      }
+
+      std::size_t const genotypes_begin = find_genotypes(line);
+
+      if (genotypes_begin == std::string_view::npos)
+        paste_error("No samples on the #CHROM line of " + input_fns[i]);
+
+      for (std::string_view const sample : split_string(line.substr(genotypes_begin), '\t'))
+      {
+        if (!sample_names.emplace(sample).second)
+          paste_error("Sample " + std::string(sample) + " of " + input_fns[i] + " is also in an earlier file");
+      }
+
+      /// Samples of later files are added to the "#CHROM" line of the first file
+      std::size_t const b = i == 0 ? 0 : genotypes_begin - 1;
+      buffer_in.insert(buffer_in.end(), line.begin() + b, line.end());
+    }
+
+    if (!is_chrom_line)
+      paste_error("No #CHROM header line in " + input_fns[i]);
+  }
+
+  buffer_in.push_back('\n');
+
+  /// Paste the genotypes of each record, the sites must be the same in all files
+  while (true)
+  {
+    std::size_t n_ended{0};
+
+    for (std::size_t i{0}; i < n_inputs; ++i)
+    {
+      if (bgzf_getline(inputs[i].get(), '\n', &lines[i]) < 0)
+        ++n_ended;
+    }
+
+    if (n_ended == n_inputs)
+      break;
+    else if (n_ended > 0)
+      paste_error("The input files have different numbers of records");
+
+    std::string_view const first_line(lines[0].s, lines[0].l);
+    std::size_t const first_genotypes_begin = find_genotypes(first_line);
+
+    if (first_genotypes_begin == std::string_view::npos)
+      paste_error("Record without genotypes in " + input_fns[0]);
+
+    std::array<std::string_view, 5> const sites = get_paste_sites(first_line, first_genotypes_begin);
+    buffer_in.insert(buffer_in.end(), first_line.begin(), first_line.end());
+
+    for (std::size_t i{1}; i < n_inputs; ++i)
+    {
+      std::string_view const line(lines[i].s, lines[i].l);
+      std::size_t const genotypes_begin = find_genotypes(line);
+
+      if (genotypes_begin == std::string_view::npos)
+        paste_error("Record without genotypes in " + input_fns[i]);
+
+      if (get_paste_sites(line, genotypes_begin) != sites)
+      {
+        paste_error("Record at " + std::string(sites[0]) + ":" + std::string(sites[1]) + " of " + input_fns[i] +
+                    " does not have the same CHROM, POS, REF, ALT and FORMAT as in " + input_fns[0]);
+      }
+
+      buffer_in.insert(buffer_in.end(), line.begin() + genotypes_begin - 1, line.end());
+    }
+
+    buffer_in.push_back('\n');
+
+    if (static_cast<long>(buffer_in.size()) >= ENC_BUFFER_SIZE)
+      encode_and_write();
   }
+
+  encode_and_write();
+
+  for (kstring_t & str : lines)
+    free(str.s);
 }
 
 } // namespace popvcf
@@ -1,14 +1,22 @@
 #pragma once
 
+#include <algorithm>
 #include <charconv>
 #include <cstdint>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include <zlib.h>
+
 #include <parallel_hashmap/phmap.h>
 
+#include "format.hpp"
+#include "history.hpp"
 #include "sequence_utils.hpp"
+#include "site_columns.hpp"
+#include "zone_map.hpp"
 
 namespace popvcf
 {
@@ -21,6 +29,29 @@ public:
   std::size_t i{b};       //!< index in buffer_in
   bool header_line{true}; //!< True iff in header line
 
+  /* Optional encoding features. */
+  FormatOptions options{};          //!< Features to encode with
+  bool is_options_written{false};   //!< True when the options header line has been written
+  bool in_frame{false};             //!< True iff in the genotypes of a record that get a prefix
+  std::size_t frame_begin{0};       //!< Index in buffer_out where the genotypes of the record begin
+  std::vector<char> frame_buffer{}; //!< Genotypes of a record that did not end in the previous buffer
+  uint32_t row_checksum{0};         //!< CRC32 of the current record so far
+  std::size_t row_size{0};          //!< Size of the current record so far
+  uint32_t block_checksum{0};       //!< CRC32 of the records of the current block
+  bool is_packed_row{false};        //!< True iff the genotypes of the current record are packed
+  std::string stored_format{};      //!< Start of a FORMAT field that continues in the next buffer
+  std::string packed_states{};      //!< Packed characters of the current record
+  std::string packed_escapes{};     //!< Escapes of the current record, each preceded by '\t'
+
+  //! Number of each seed in options.seeds, which set_options fills
+  phmap::flat_hash_map<std::string, uint32_t> seed_map{};
+
+  /* Zone map of the output, if it is written. */
+  ZoneMap * zone_map{nullptr}; //!< Summary of each block, nullptr if it is not written
+  uint64_t out_offset{0};      //!< Offset in the output of the buffer that is encoded
+  uint64_t row_offset{0};      //!< Offset in the output of the current record
+  bool is_gt_format{false};    //!< True iff GT is the first key of the FORMAT of the current record
+
   /* Data fields from previous line. */
   std::vector<std::string> prev_unique_fields{};
   std::vector<uint32_t> prev_field2uid{};
@@ -39,12 +70,53 @@ public:
   std::string next_contig{};
   int64_t next_pos{0};
 
+  /* Earlier lines of the block, used with the allele_history option. */
+  RowHistory history{};
+  uint32_t history_back{0}; //!< How many lines back the line that prev_* holds is
+
+  /* Site columns of the previous line of the block, used with the site_columns option. */
+  SiteColumns site_columns{};
+  std::string stored_column{}; //!< Start of a site column that continues in the next buffer
+
+  //! Sets the features to encode with.
+  inline void set_options(FormatOptions const & new_options)
+  {
+    options = new_options;
+    seed_map.clear();
+
+    for (uint32_t s{0}; s < options.seeds.size(); ++s)
+      seed_map.emplace(options.seeds[s], s);
+  }
+
+  //! Returns true iff the next line, on next_contig at \a next_pos, is in another block than the current line.
+  inline bool is_new_block(int64_t const next_pos) const
+  {
+    return !is_same_block(next_contig, next_pos, contig, pos);
+  }
+
   inline void clear_line(int64_t next_pos, int32_t next_n_alt)
   {
     next_n_alt += stored_alt;
     stored_alt = 0;
+    bool const is_new_block = this->is_new_block(next_pos);
+
+    if (is_new_block)
+      block_checksum = 0;
+
+    if (options.allele_history)
+    {
+      /// Refer to the latest record of the block with as many ALT alleles, or the previous record
+      history.give_back(*this);
+
+      if (is_new_block)
+        history.clear();
+      else
+        history.push(*this);
 
-    if (next_contig != contig || (next_pos / 10000) != (pos / 10000))
+      history_back = history.find(next_n_alt);
+      history.lend(*this, history_back);
+    }
+    else if (is_new_block)
     {
       /// Previous line is not available, clear values
       prev_unique_fields.resize(0);
@@ -82,12 +154,178 @@ inline void set_input_size(Tenc_array_buf & /*buffer_in*/, EncodeData & /*ed*/)
   // NOTE: dd.in_size must be set prior to calling decode_buffer in arrays
 }
 
+//! Adds data of the current record to its checksum.
+inline void update_checksum(EncodeData & ed, char const * data, std::size_t const size)
+{
+  ed.row_checksum = crc32(ed.row_checksum, reinterpret_cast<Bytef const *>(data), size);
+  ed.row_size += size;
+}
+
+//! Adds the checksum of the record that ended to the checksum of its block.
+inline void close_checksum(EncodeData & ed)
+{
+  ed.block_checksum = crc32_combine(ed.block_checksum, ed.row_checksum, ed.row_size);
+  ed.row_checksum = 0;
+  ed.row_size = 0;
+}
+
+//! Writes the prefix of the genotypes of a record in front of them. The prefix has their length if the records are
+//! framed and the checksum of the block up to and including the record if checksums are enabled.
+template <typename Tbuffer_out>
+inline void close_frame(Tbuffer_out & buffer_out, EncodeData & ed)
+{
+  assert(ed.frame_begin <= buffer_out.size());
+  std::string prefix;
+
+  if (ed.options.framed)
+    popvcf::to_chars(buffer_out.size() - ed.frame_begin, prefix);
+
+  if (ed.options.checksum)
+  {
+    if (ed.options.framed)
+      prefix.push_back(',');
+
+    popvcf::to_chars(ed.block_checksum, prefix);
+  }
+
+  prefix.push_back('\t');
+  buffer_out.insert(buffer_out.begin() + ed.frame_begin, prefix.begin(), prefix.end());
+  ed.in_frame = false;
+}
+
+//! Returns true if GT is the first key of the FORMAT field of the current record, which ends with \a format.
+inline bool is_gt_first(EncodeData const & ed, std::string_view const format)
+{
+  std::string const full_format = ed.stored_format + std::string(format);
+  return full_format.compare(0, 2, "GT") == 0 && (full_format.size() == 2 || full_format[2] == ':');
+}
+
+//! Adds the record that ended to the zone map, if it is written.
+inline void update_zone_map(EncodeData & ed)
+{
+  if (ed.zone_map != nullptr)
+  {
+    ed.zone_map->add_record(
+      ed.contig, ed.pos, ed.n_alt, ed.is_gt_format, ed.unique_fields, ed.field2uid, ed.row_offset);
+  }
+}
+
+//! Returns true if the genotypes of a record with \a format and a single ALT allele are packed.
+inline bool is_packed_format(EncodeData const & ed, std::string_view const format)
+{
+  if (!ed.options.packed || ed.n_alt != 0)
+    return false;
+
+  if (ed.stored_format.empty())
+    return format == "GT";
+
+  return ed.stored_format.size() + format.size() == 2 && ed.stored_format + std::string(format) == "GT";
+}
+
+//! Adds the state of the genotype field of sample \a field_idx, which is the last field in ed.field2uid, to a packed
+//! record. \a is_new is true if it is the first appearance of the field in the record.
+inline void pack_field(EncodeData & ed, std::size_t const field_idx, bool const is_new, std::string_view const field)
+{
+  uint32_t const uid = ed.field2uid.back();
+  uint32_t const state = std::min(uid, PACKED_ESCAPE);
+  uint32_t const shift = 2 * (field_idx % 3);
+
+  if (shift == 0)
+    ed.packed_states.push_back(PACKED_CHAR_MIN);
+
+  ed.packed_states.back() += static_cast<char>(state << shift);
+
+  if (state == PACKED_ESCAPE)
+  {
+    ed.packed_escapes.push_back('\t');
+
+    if (is_new)
+      ed.packed_escapes.append(field);
+    else
+      popvcf::to_chars(uid, ed.packed_escapes);
+  }
+}
+
+//! Writes the token before the genotypes of a record that refers to an earlier record than the previous one.
+template <typename Tbuffer_out>
+inline void write_history_marker(Tbuffer_out & buffer_out, EncodeData const & ed)
+{
+  if (ed.history_back > 1)
+  {
+    buffer_out.push_back(HISTORY_MARKER);
+    popvcf::to_chars(ed.history_back, buffer_out);
+    buffer_out.push_back('\t');
+  }
+}
+
+//! Writes a site column that ends at ed.i, encoded against the same column of the previous line, and its delimiter.
+template <typename Tbuffer_out, typename Tbuffer_in>
+inline void write_site_column(Tbuffer_out & buffer_out, Tbuffer_in const & buffer_in, EncodeData & ed)
+{
+  std::string_view column(&buffer_in[ed.b], ed.i - ed.b);
+
+  if (!ed.stored_column.empty())
+  {
+    ed.stored_column.append(column);
+    column = ed.stored_column;
+  }
+
+  ed.site_columns.encode(buffer_out, ed.field, column);
+  ed.stored_column.resize(0);
+  buffer_out.push_back(buffer_in[ed.i]);
+}
+
+//! Writes the genotypes of a packed record that has ended.
+template <typename Tbuffer_out>
+inline void write_packed_row(Tbuffer_out & buffer_out, EncodeData & ed)
+{
+  std::size_t const n_samples = ed.field2uid.size();
+  std::size_t const n_fields = std::min<std::size_t>(ed.unique_fields.size(), PACKED_ESCAPE);
+
+  buffer_out.push_back(PACKED_ROW_MARKER);
+  buffer_out.push_back('0' + (n_samples - 1) % 3 + 1);
+  buffer_out.push_back('0' + n_fields);
+  buffer_out.insert(buffer_out.end(), ed.packed_states.begin(), ed.packed_states.end());
+
+  for (std::size_t u{0}; u < n_fields; ++u)
+  {
+    buffer_out.push_back('\t');
+    buffer_out.insert(buffer_out.end(), ed.unique_fields[u].begin(), ed.unique_fields[u].end());
+  }
+
+  buffer_out.insert(buffer_out.end(), ed.packed_escapes.begin(), ed.packed_escapes.end());
+  buffer_out.push_back('\n');
+
+  ed.packed_states.resize(0);
+  ed.packed_escapes.resize(0);
+  ed.is_packed_row = false;
+}
+
 //! Encodes an input buffer. Output is written in \a buffer_out.
 template <typename Tbuffer_out, typename Tbuffer_in>
 inline void encode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, EncodeData & ed)
 {
   set_input_size(buffer_in, ed);
+
+  if (ed.in_frame)
+  {
+    /// Continue the record from the previous buffer. Its genotypes are swapped in rather than copied if the output
+    /// buffer is empty, so a record that spans many buffers is not copied again for each of them.
+    ed.frame_begin = buffer_out.size();
+
+    if (buffer_out.empty())
+    {
+      buffer_out.swap(ed.frame_buffer);
+    }
+    else
+    {
+      buffer_out.insert(buffer_out.end(), ed.frame_buffer.begin(), ed.frame_buffer.end());
+      ed.frame_buffer.resize(0);
+    }
+  }
+
   buffer_out.reserve(ENC_BUFFER_SIZE);
+
   std::size_t constexpr N_FIELDS_SITE_DATA{9}; // how many fields of the VCF contains site data
   int64_t next_pos{0};
 
@@ -106,27 +344,83 @@ inline void encode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Enco
       // check if in header line and store contig
       ed.header_line = buffer_in[ed.b] == '#'; // check if in header line
 
+      /// The options header line goes right before the "#CHROM" line, or the first record if there is none
+      if (!ed.is_options_written && ed.options.any() &&
+          (!ed.header_line || (ed.i - ed.b > 1 && buffer_in[ed.b + 1] != '#')))
+      {
+        std::string const options_line = ed.options.to_header_line();
+        buffer_out.insert(buffer_out.end(), options_line.begin(), options_line.end());
+        ed.is_options_written = true;
+      }
+
       if (not ed.header_line)
+      {
         ed.next_contig.assign(&buffer_in[ed.b], ed.i - ed.b);
+        ed.row_offset = ed.out_offset + buffer_out.size();
+      }
     }
     else if (not ed.header_line)
     {
       if (ed.field == 1) /*POS field*/
       {
         std::from_chars(&buffer_in[ed.b], &buffer_in[ed.i], next_pos);
+
+        if (ed.options.site_columns && ed.is_new_block(next_pos))
+          ed.site_columns.clear();
       }
       else if (ed.field == 4) /*ALT field*/
       {
         int32_t next_n_alt = std::count(&buffer_in[ed.b], &buffer_in[ed.i], ',');
         ed.clear_line(next_pos, next_n_alt);
       }
+      else if (ed.field == 8) /*FORMAT field*/
+      {
+        std::string_view const format(&buffer_in[ed.b], ed.i - ed.b);
+        ed.is_packed_row = b_in == '\t' && is_packed_format(ed, format);
+
+        if (ed.zone_map != nullptr)
+          ed.is_gt_format = is_gt_first(ed, format);
+
+        ed.stored_format.resize(0);
+      }
     }
 
-    if (ed.header_line || ed.field < N_FIELDS_SITE_DATA)
+    if (!ed.header_line && ed.options.site_columns && is_coded_site_column(ed.field))
+    {
+      write_site_column(buffer_out, buffer_in, ed);
+      ++ed.i;
+    }
+    else if (ed.header_line || ed.field < N_FIELDS_SITE_DATA)
     {
       ++ed.i; // adds '\t' or '\n' and then insert the field to the output buffer
       buffer_out.insert(buffer_out.end(), &buffer_in[ed.b], &buffer_in[ed.i]);
     }
+    else if (ed.is_packed_row)
+    {
+      auto insert_it = ed.map_to_unique_fields.insert(
+        std::pair<std::string, uint32_t>(std::piecewise_construct,
+                                         std::forward_as_tuple(&buffer_in[ed.b], ed.i - ed.b),
+                                         std::forward_as_tuple(ed.unique_fields.size())));
+
+      long const field_idx = ed.field - N_FIELDS_SITE_DATA;
+
+      if (field_idx == 0 && ed.options.has_record_prefix())
+      {
+        ed.in_frame = true;
+        ed.frame_begin = buffer_out.size();
+      }
+
+      if (insert_it.second == true)
+        ed.unique_fields.emplace_back(&buffer_in[ed.b], ed.i - ed.b);
+
+      /// The genotypes are written when the record ends
+      ed.field2uid.push_back(insert_it.first->second);
+      pack_field(ed, field_idx, insert_it.second, insert_it.first->first);
+      ++ed.i;
+
+      if (b_in == '\n')
+        write_packed_row(buffer_out, ed);
+    }
     else
     {
       assert(buffer_in[ed.b] >= '!');
@@ -141,6 +435,15 @@ inline void encode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Enco
       long const field_idx = ed.field - N_FIELDS_SITE_DATA;
       assert(field_idx == static_cast<long>(ed.field2uid.size()));
 
+      if (field_idx == 0 && ed.options.has_record_prefix())
+      {
+        ed.in_frame = true;
+        ed.frame_begin = buffer_out.size();
+      }
+
+      if (field_idx == 0)
+        write_history_marker(buffer_out, ed);
+
       if (insert_it.second == true)
       {
         ed.field2uid.push_back(ed.unique_fields.size());
@@ -162,13 +465,7 @@ inline void encode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Enco
           // check if it is in the previous line
           auto prev_find_it = ed.prev_map_to_unique_fields.find(insert_it.first->first);
 
-          if (prev_find_it == ed.prev_map_to_unique_fields.end())
-          {
-            /* Case 1: Field is unique in the current line and is not in the previous line. */
-            ++ed.i; // adds '\t' or '\n'
-            buffer_out.insert(buffer_out.end(), &buffer_in[ed.b], &buffer_in[ed.i]);
-          }
-          else
+          if (prev_find_it != ed.prev_map_to_unique_fields.end())
           {
             /* Case 2: Field is unique in the current line but identical to a field in the previous line. */
             buffer_out.push_back('%');
@@ -176,6 +473,20 @@ inline void encode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Enco
             buffer_out.push_back(buffer_in[ed.i]); // write '\t' or '\n'
             ++ed.i;
           }
+          else if (auto seed_find_it = ed.seed_map.find(insert_it.first->first); seed_find_it != ed.seed_map.end())
+          {
+            /* Case 5: Field is unique in the current line and not in the previous line, but it is a seed. */
+            buffer_out.push_back(SEED_MARKER);
+            popvcf::to_chars(seed_find_it->second, buffer_out);
+            buffer_out.push_back(buffer_in[ed.i]); // write '\t' or '\n'
+            ++ed.i;
+          }
+          else
+          {
+            /* Case 1: Field is unique in the current line and is not in the previous line. */
+            ++ed.i; // adds '\t' or '\n'
+            buffer_out.insert(buffer_out.end(), &buffer_in[ed.b], &buffer_in[ed.i]);
+          }
         }
       }
       else
@@ -207,22 +518,47 @@ inline void encode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Enco
     }
 
     assert(b_in == buffer_in[ed.i - 1]); // i should have been already incremented here
-    ed.b = ed.i;                         // set begin index of next field
+
+    if (ed.options.checksum && !ed.header_line)
+      update_checksum(ed, &buffer_in[ed.b], ed.i - ed.b);
+
+    ed.b = ed.i; // set begin index of next field
 
     // check if we need to clear line or increment field
     if (b_in == '\n')
+    {
+      if (ed.options.checksum && !ed.header_line)
+        close_checksum(ed);
+
+      if (ed.in_frame)
+        close_frame(buffer_out, ed);
+
+      if (!ed.header_line)
+        update_zone_map(ed);
+
       ed.field = 0; // reset field index
+    }
     else
+    {
       ++ed.field;
+    }
   } // ends inner loop
 
   if (ed.field >= 3 && ed.field < N_FIELDS_SITE_DATA)
   {
-    // write the data even if the field is not complete
-    buffer_out.insert(buffer_out.end(), &buffer_in[ed.b], &buffer_in[ed.i]);
+    // write the data even if the field is not complete, unless it is encoded when it is complete
+    if (!ed.header_line && ed.options.site_columns && is_coded_site_column(ed.field))
+      ed.stored_column.append(&buffer_in[ed.b], ed.i - ed.b);
+    else
+      buffer_out.insert(buffer_out.end(), &buffer_in[ed.b], &buffer_in[ed.i]);
+
+    if (ed.options.checksum && !ed.header_line)
+      update_checksum(ed, &buffer_in[ed.b], ed.i - ed.b);
 
     if (ed.field == 4) /*ALT field*/
       ed.stored_alt = std::count(&buffer_in[ed.b], &buffer_in[ed.i], ',');
+    else if (ed.field == 8) /*FORMAT field*/
+      ed.stored_format.append(&buffer_in[ed.b], ed.i - ed.b);
 
     ed.i = 0;
   }
@@ -233,17 +569,59 @@ inline void encode_buffer(Tbuffer_out & buffer_out, Tbuffer_in & buffer_in, Enco
     ed.i = ed.i - ed.b;
   }
 
+  if (ed.in_frame)
+  {
+    /// Hold back the genotypes of an unfinished record since their prefix is not known yet
+    if (ed.frame_begin == 0)
+    {
+      assert(ed.frame_buffer.empty());
+      buffer_out.swap(ed.frame_buffer);
+    }
+    else
+    {
+      ed.frame_buffer.assign(buffer_out.begin() + ed.frame_begin, buffer_out.end());
+      buffer_out.resize(ed.frame_begin);
+    }
+  }
+
   ed.b = 0;
   ed.in_size = ed.i;
   resize_input_buffer(buffer_in, ed.i);
 }
 
-//! Encode a gzipped file and write to stdout
+//! Encode a gzipped file and write to stdout. Rows with wide genotypes are encoded by \a row_threads threads if it is
+//! greater than one. With \a write_zone_map, the zone map of the output is written next to it and a bgzipped output
+//! also gets a .gzi index. If \a checkpoint_interval is not 0, a checkpoint is saved next to the output at the first
+//! block after every \a checkpoint_interval bytes of input, and with \a is_resume the encoding continues from it.
+//! With \a is_verify, the output is decoded on another thread while encoding and compared with the input.
 void encode_file(std::string const & input_fn,
                  bool const is_bgzf_input,
                  std::string const & output_fn,
                  std::string const & output_mode,
                  bool const is_bgzf_output,
-                 int const compression_threads);
+                 int const compression_threads,
+                 int const row_threads,
+                 bool const write_zone_map,
+                 FormatOptions const & options,
+                 uint64_t const checkpoint_interval,
+                 bool const is_resume,
+                 bool const is_verify);
+
+//! Returns the genotype fields that are in the most of the first records of a VCF, to use as seeds.
+std::vector<std::string> learn_seeds(std::string const & input_fn);
+
+//! Reads seeds from a file with one genotype field per line.
+std::vector<std::string> read_seeds(std::string const & seeds_fn);
+
+//! Encodes VCF files with the same records and different samples as if their genotype columns were pasted side by
+//! side, without writing the pasted VCF. CHROM, POS, REF, ALT and FORMAT must be the same in all files, the other site
+//! columns and the header are taken from the first file.
+void encode_paste(std::vector<std::string> const & input_fns,
+                  std::string const & output_fn,
+                  std::string const & output_mode,
+                  bool const is_bgzf_output,
+                  int const compression_threads,
+                  int const row_threads,
+                  FormatOptions const & options);
 
 } // namespace popvcf
@@ -0,0 +1,125 @@
+#include "export.hpp"
+
+#include <cstdint>     // uint8_t
+#include <cstdio>      // fwrite
+#include <iostream>    // std::cerr
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+#include "genotype.hpp"
+#include "io.hpp"
+#include "reader.hpp"
+
+namespace popvcf
+{
+namespace
+{
+/* 2-bit genotype codes of PLINK 1 .bed files, where A1 is ALT and A2 is REF. */
+uint8_t constexpr PLINK_HOM_A1{0};  //!< Homozygous ALT
+uint8_t constexpr PLINK_MISSING{1}; //!< Missing genotype
+uint8_t constexpr PLINK_HET{2};     //!< Heterozygous
+uint8_t constexpr PLINK_HOM_A2{3};  //!< Homozygous REF
+
+//! Returns the PLINK code of a biallelic genotype field. Haploid genotypes are coded as homozygous.
+uint8_t get_plink_code(std::string_view const field, std::vector<int32_t> & alleles)
+{
+  parse_gt(field, alleles);
+
+  if (alleles.empty() || alleles.size() > 2)
+    return PLINK_MISSING;
+
+  int32_t const a0 = alleles[0];
+  int32_t const a1 = alleles.back();
+
+  if (a0 == MISSING_ALLELE || a1 == MISSING_ALLELE || a0 > 1 || a1 > 1)
+    return PLINK_MISSING;
+  else if (a0 != a1)
+    return PLINK_HET;
+  else
+    return a0 == 0 ? PLINK_HOM_A2 : PLINK_HOM_A1;
+}
+
+} // namespace
+
+void export_plink(std::string const & popvcf_fn, std::string const & region, std::string const & prefix)
+{
+  RecordReader reader(popvcf_fn, region);
+  std::vector<std::string> const sample_names = reader.get_sample_names();
+  std::size_t const n_samples = sample_names.size();
+
+  file_ptr bed = popvcf::open_vcf(prefix + ".bed", "wb");
+  file_ptr bim = popvcf::open_vcf(prefix + ".bim", "w");
+  file_ptr fam = popvcf::open_vcf(prefix + ".fam", "w");
+
+  /// Each sample is its own family, as with "plink --double-id"
+  std::string line;
+
+  for (std::string const & name : sample_names)
+  {
+    line.resize(0);
+    line.append(name).append("\t").append(name).append("\t0\t0\t0\t-9\n");
+    fwrite(line.data(), 1, line.size(), fam.get());
+  }
+
+  /// Magic number and SNP-major mode
+  uint8_t constexpr BED_HEADER[3] = {0x6c, 0x1b, 0x01};
+  fwrite(BED_HEADER, 1, sizeof(BED_HEADER), bed.get());
+
+  std::vector<uint8_t> codes;   // PLINK code of each unique genotype field
+  std::vector<int32_t> alleles; // alleles of a unique genotype field
+  std::vector<uint8_t> bytes;   // genotypes of a record in .bed format, four samples per byte
+  uint64_t n_exported{0};
+  uint64_t n_skipped{0};
+
+  while (reader.next())
+  {
+    DecodeData const & dd = reader.dd;
+    std::string_view const alt = reader.get_site_column(4);
+    std::string_view const format = reader.get_site_column(8);
+    bool const has_gt = format.substr(0, 2) == "GT" && (format.size() == 2 || format[2] == ':');
+
+    if (!has_gt || alt == "." || alt.find(',') != std::string_view::npos || dd.field2uid.size() != n_samples)
+    {
+      ++n_skipped;
+      continue;
+    }
+
+    /// Map each unique genotype field to its code once
+    codes.resize(dd.unique_fields.size());
+
+    for (std::size_t uid{0}; uid < codes.size(); ++uid)
+      codes[uid] = get_plink_code(dd.unique_fields[uid], alleles);
+
+    /// Scatter the codes to the samples
+    bytes.assign((n_samples + 3) / 4, 0);
+    uint32_t const * field2uid = dd.field2uid.data();
+    std::size_t s{0};
+
+    for (; s + 4 <= n_samples; s += 4)
+    {
+      bytes[s / 4] = codes[field2uid[s]] | (codes[field2uid[s + 1]] << 2) | (codes[field2uid[s + 2]] << 4) |
+                     (codes[field2uid[s + 3]] << 6);
+    }
+
+    for (; s < n_samples; ++s)
+      bytes[s / 4] |= codes[field2uid[s]] << (2 * (s % 4));
+
+    fwrite(bytes.data(), 1, bytes.size(), bed.get());
+
+    /// CHROM, ID, position in morgans, POS, A1 and A2
+    line.resize(0);
+    line.append(reader.get_site_column(0)).append("\t");
+    line.append(reader.get_site_column(2)).append("\t0\t");
+    line.append(reader.get_site_column(1)).append("\t");
+    line.append(alt).append("\t");
+    line.append(reader.get_site_column(3)).append("\n");
+    fwrite(line.data(), 1, line.size(), bim.get());
+    ++n_exported;
+  }
+
+  std::cerr << "[popvcf] Exported " << n_exported << " records, skipped " << n_skipped
+            << " records that are not biallelic or have no GT." << std::endl;
+}
+
+} // namespace popvcf
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+namespace popvcf
+{
+//! Writes the biallelic records of a popVCF, optionally in a \a region, as PLINK 1 binary files \a prefix.bed,
+//! \a prefix.bim and \a prefix.fam. The GT of each unique genotype field is mapped to its 2-bit code once per record
+//! and the codes are scattered to the samples, so genotypes are never decoded to text. Records with more than one ALT
+//! allele or without GT are skipped. ALT is the first allele (A1) and REF the second (A2) in the .bim file.
+void export_plink(std::string const & popvcf_fn, std::string const & region, std::string const & prefix);
+
+} // namespace popvcf
@@ -0,0 +1,412 @@
+#include "filter.hpp"
+
+#include <algorithm>   // std::all_of, std::any_of, std::max
+#include <charconv>    // std::from_chars
+#include <cstdio>      // fwrite
+#include <cstdlib>     // std::exit, std::strtod
+#include <iostream>    // std::cerr
+#include <stdexcept>   // std::runtime_error
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+#include "genotype.hpp"
+#include "reader.hpp"
+#include "sequence_utils.hpp" // DEC_BUFFER_SIZE
+#include "zone_map.hpp"
+
+namespace popvcf
+{
+namespace
+{
+std::string_view trim(std::string_view str)
+{
+  std::size_t const b = str.find_first_not_of(" \t");
+
+  if (b == std::string_view::npos)
+    return std::string_view();
+
+  return str.substr(b, str.find_last_not_of(" \t") - b + 1);
+}
+
+template <typename T>
+bool compare(T const lhs, T const rhs, CompareOp const op)
+{
+  switch (op)
+  {
+  case CompareOp::EQ:
+    return lhs == rhs;
+  case CompareOp::NE:
+    return lhs != rhs;
+  case CompareOp::LT:
+    return lhs < rhs;
+  case CompareOp::LE:
+    return lhs <= rhs;
+  case CompareOp::GT:
+    return lhs > rhs;
+  default:
+    return lhs >= rhs;
+  }
+}
+
+//! Returns true if \a str is a number, which is stored in \a number.
+bool parse_number(std::string_view str, double & number)
+{
+  std::string const copy(str); // strtod requires a null terminated string
+  char * end{nullptr};
+  number = std::strtod(copy.c_str(), &end);
+  return !copy.empty() && end == copy.c_str() + copy.size();
+}
+
+//! Writes the first eight columns of a line, which ends with a newline.
+void append_site_columns(std::string_view line, std::vector<char> & buffer_out)
+{
+  std::size_t tab{0};
+
+  for (long c{0}; c < 8 && tab != std::string_view::npos; ++c)
+    tab = line.find('\t', c == 0 ? 0 : tab + 1);
+
+  if (tab == std::string_view::npos)
+  {
+    buffer_out.insert(buffer_out.end(), line.begin(), line.end());
+  }
+  else
+  {
+    buffer_out.insert(buffer_out.end(), line.begin(), line.begin() + tab);
+    buffer_out.push_back('\n');
+  }
+}
+
+//! Returns true if the current record of \a reader is the first record of \a zone.
+bool is_zone_begin(RecordReader const & reader, Zone const & zone)
+{
+  std::string_view const pos = reader.get_site_column(1);
+  int64_t vcf_pos{0};
+  std::from_chars(pos.data(), pos.data() + pos.size(), vcf_pos);
+  return reader.get_site_column(0) == zone.contig && vcf_pos == zone.pos_min;
+}
+
+} // namespace
+
+bool SampleCondition::evaluate(std::string_view subfield, std::vector<int32_t> & gt_alleles) const
+{
+  bool result{false};
+
+  if (key == "GT")
+  {
+    parse_gt(subfield, gt_alleles);
+    bool const is_missing =
+      gt_alleles.empty() || std::any_of(gt_alleles.begin(), gt_alleles.end(), [](int32_t a) { return a < 0; });
+    bool const is_hom =
+      std::all_of(gt_alleles.begin(), gt_alleles.end(), [&](int32_t a) { return a == gt_alleles[0]; });
+
+    if (value == "ref")
+      result = !is_missing && is_hom && gt_alleles[0] == 0;
+    else if (value == "alt")
+      result = std::any_of(gt_alleles.begin(), gt_alleles.end(), [](int32_t a) { return a > 0; });
+    else if (value == "het")
+      result = !is_missing && !is_hom;
+    else if (value == "hom")
+      result = !is_missing && is_hom;
+    else if (value == "miss")
+      result = is_missing;
+    else
+      result = gt_alleles == alleles;
+
+    return op == CompareOp::EQ ? result : !result;
+  }
+
+  if (!is_numeric)
+    return compare(subfield, std::string_view(value), op);
+
+  /// Any value of a list may satisfy the condition
+  for (std::string_view const item : split_string(subfield, ','))
+  {
+    double item_number{0.0};
+
+    if (item != "." && parse_number(item, item_number) && compare(item_number, number, op))
+      return true;
+  }
+
+  return false;
+}
+
+RecordFilter::RecordFilter(std::string const & expression)
+{
+  std::string_view const expr(expression);
+
+  if (expr.find("||") != std::string_view::npos)
+    throw std::runtime_error("Only '&&' can join conditions in a filter expression: " + expression);
+
+  std::size_t b{0};
+
+  while (true)
+  {
+    std::size_t const e = std::min(expr.find("&&", b), expr.size());
+    std::string_view const term = trim(expr.substr(b, e - b));
+    std::size_t const p = term.find_first_of("=!<>");
+
+    if (p == std::string_view::npos || p == 0)
+      throw std::runtime_error("Could not parse the filter condition: " + std::string(term));
+
+    /// Parse the operator
+    CompareOp op{CompareOp::EQ};
+    bool const is_two_chars = p + 1 < term.size() && term[p + 1] == '=';
+
+    if (term[p] == '!' && !is_two_chars)
+      throw std::runtime_error("Could not parse the filter condition: " + std::string(term));
+
+    if (term[p] == '!')
+      op = CompareOp::NE;
+    else if (term[p] == '<')
+      op = is_two_chars ? CompareOp::LE : CompareOp::LT;
+    else if (term[p] == '>')
+      op = is_two_chars ? CompareOp::GE : CompareOp::GT;
+
+    std::string_view const key = trim(term.substr(0, p));
+    std::string_view value = trim(term.substr(p + (is_two_chars ? 2 : 1)));
+
+    if (value.size() >= 2 && (value[0] == '"' || value[0] == '\'') && value.back() == value[0])
+      value = value.substr(1, value.size() - 2);
+
+    if (key == "N_PASS")
+    {
+      auto ret = std::from_chars(value.data(), value.data() + value.size(), n_pass_value);
+
+      if (ret.ec != std::errc() || ret.ptr != value.data() + value.size())
+        throw std::runtime_error("N_PASS must be compared with an integer: " + std::string(term));
+
+      n_pass_op = op;
+    }
+    else
+    {
+      SampleCondition condition;
+      condition.key = key;
+      condition.op = op;
+      condition.value = value;
+      condition.is_numeric = parse_number(value, condition.number);
+
+      if (key == "GT")
+      {
+        if (op != CompareOp::EQ && op != CompareOp::NE)
+          throw std::runtime_error("GT can only be compared with '==' or '!=': " + std::string(term));
+
+        if (value != "ref" && value != "alt" && value != "het" && value != "hom" && value != "miss")
+        {
+          parse_gt(value, condition.alleles);
+
+          if (condition.alleles.empty())
+            throw std::runtime_error("Could not parse the genotype in the filter condition: " + std::string(term));
+        }
+      }
+      else if (!condition.is_numeric && op != CompareOp::EQ && op != CompareOp::NE)
+      {
+        throw std::runtime_error("Only numbers can be compared with '<' or '>': " + std::string(term));
+      }
+
+      conditions.push_back(std::move(condition));
+    }
+
+    if (e == expr.size())
+      break;
+
+    b = e + 2;
+  }
+}
+
+bool RecordFilter::evaluate(RecordReader const & reader)
+{
+  DecodeData const & dd = reader.dd;
+
+  /// Find the subfields of the conditions in the FORMAT of this record
+  std::vector<std::string_view> const format_keys = split_string(reader.get_site_column(8), ':');
+  subfield_indices.assign(conditions.size(), -1);
+
+  for (std::size_t c{0}; c < conditions.size(); ++c)
+  {
+    for (std::size_t k{0}; k < format_keys.size(); ++k)
+    {
+      if (format_keys[k] == conditions[c].key)
+        subfield_indices[c] = k;
+    }
+  }
+
+  /// Evaluate the sample conditions once for each unique genotype field
+  is_passing.assign(dd.unique_fields.size(), 1);
+  long n_passing_unique{0};
+
+  for (std::size_t uid{0}; uid < dd.unique_fields.size(); ++uid)
+  {
+    for (std::size_t c{0}; c < conditions.size() && is_passing[uid]; ++c)
+    {
+      is_passing[uid] = subfield_indices[c] >= 0 &&
+                        conditions[c].evaluate(get_subfield(dd.unique_fields[uid], subfield_indices[c]), gt_alleles);
+    }
+
+    n_passing_unique += is_passing[uid];
+  }
+
+  /// Count passing samples, which is only needed if some but not all unique genotype fields pass
+  long n_pass{0};
+
+  if (n_passing_unique == static_cast<long>(dd.unique_fields.size()))
+  {
+    n_pass = dd.field2uid.size();
+  }
+  else if (n_passing_unique > 0)
+  {
+    bool const is_lower_bound = n_pass_op == CompareOp::GE || n_pass_op == CompareOp::GT;
+    long const enough = n_pass_op == CompareOp::GE ? n_pass_value : n_pass_value + 1;
+
+    for (uint32_t const uid : dd.field2uid)
+    {
+      n_pass += is_passing[uid];
+
+      if (is_lower_bound && n_pass >= enough)
+        return true;
+    }
+  }
+
+  return compare(n_pass, n_pass_value, n_pass_op);
+}
+
+uint64_t RecordFilter::get_min_alt_count() const
+{
+  bool const is_carrier_required =
+    std::any_of(conditions.begin(),
+                conditions.end(),
+                [](SampleCondition const & c)
+                {
+                  return c.key == "GT" && c.op == CompareOp::EQ &&
+                         (c.value == "alt" || c.value == "het" ||
+                          std::any_of(c.alleles.begin(), c.alleles.end(), [](int32_t a) { return a > 0; }));
+                });
+
+  if (!is_carrier_required)
+    return 0;
+
+  /// Each passing sample has at least one non-reference allele
+  if (n_pass_op == CompareOp::GE || n_pass_op == CompareOp::EQ)
+    return std::max(0l, n_pass_value);
+  else if (n_pass_op == CompareOp::GT)
+    return std::max(0l, n_pass_value + 1);
+  else
+    return 0;
+}
+
+void decode_filtered(std::string const & popvcf_fn,
+                     std::string const & region,
+                     std::string const & expression,
+                     bool const drop_genotypes)
+{
+  RecordFilter filter(expression);
+  RecordReader reader(popvcf_fn, region);
+  std::vector<char> buffer_out;
+  buffer_out.reserve(2 * DEC_BUFFER_SIZE);
+
+  /// Write the header
+  if (drop_genotypes)
+  {
+    std::string_view const header(reader.header.data(), reader.header.size());
+    std::size_t const pos = header.rfind("#CHROM");
+    std::size_t const column_header_pos = pos == std::string_view::npos ? header.size() : pos;
+    buffer_out.insert(buffer_out.end(), header.begin(), header.begin() + column_header_pos);
+    append_site_columns(header.substr(column_header_pos), buffer_out);
+  }
+  else
+  {
+    buffer_out.insert(buffer_out.end(), reader.header.begin(), reader.header.end());
+  }
+
+  auto filter_record = [&]()
+  {
+    if (!filter.evaluate(reader))
+      return; // the genotypes of the record are never written out
+
+    DecodeData const & dd = reader.dd;
+
+    if (drop_genotypes)
+    {
+      append_site_columns(std::string_view(reader.site.data(), reader.site.size()), buffer_out);
+    }
+    else
+    {
+      buffer_out.insert(buffer_out.end(), reader.site.begin(), reader.site.end());
+
+      for (uint32_t const uid : dd.field2uid)
+      {
+        buffer_out.insert(buffer_out.end(), dd.unique_fields[uid].begin(), dd.unique_fields[uid].end());
+        buffer_out.push_back('\t');
+      }
+
+      if (!dd.field2uid.empty())
+        buffer_out.back() = '\n';
+    }
+
+    if (static_cast<long>(buffer_out.size()) >= DEC_BUFFER_SIZE)
+    {
+      fwrite(buffer_out.data(), 1, buffer_out.size(), stdout);
+      buffer_out.resize(0);
+    }
+  };
+
+  /// Blocks that cannot have passing records are skipped with the zone map, if there is one
+  ZoneMap zone_map;
+  uint64_t const min_alt_count = filter.get_min_alt_count();
+
+  bool is_zone_map{region.empty() && min_alt_count > 0 && zone_map.read(popvcf_fn + ZONE_MAP_SUFFIX)};
+
+  /// A zone map of an earlier popVCF with the same name may skip blocks that now have passing records
+  if (is_zone_map && zone_map.is_stale(popvcf_fn))
+  {
+    std::cerr << "[popvcf] WARNING: " << popvcf_fn << " has changed since its zone map was written, the zone map "
+              << "is not used." << std::endl;
+    is_zone_map = false;
+  }
+
+  if (is_zone_map)
+  {
+    if (!reader.load_gzi(popvcf_fn))
+    {
+      std::cerr << "[popvcf] ERROR: Could not load the .gzi index of " << popvcf_fn << ", which the zone map requires."
+                << std::endl;
+      std::exit(1);
+    }
+
+    bool is_at_zone{true}; // true iff the reader is at the first record of the next zone
+
+    for (Zone const & zone : zone_map.zones)
+    {
+      if (zone.ac_max < min_alt_count)
+      {
+        is_at_zone = false;
+        continue;
+      }
+
+      if (!is_at_zone)
+        reader.seek(zone.offset);
+
+      for (uint64_t r{0}; r < zone.n_records; ++r)
+      {
+        if (!reader.next() || (r == 0 && !is_zone_begin(reader, zone)))
+        {
+          std::cerr << "[popvcf] ERROR: The zone map of " << popvcf_fn << " does not match the popVCF." << std::endl;
+          std::exit(1);
+        }
+
+        filter_record();
+      }
+
+      is_at_zone = true;
+    }
+  }
+  else
+  {
+    while (reader.next())
+      filter_record();
+  }
+
+  fwrite(buffer_out.data(), 1, buffer_out.size(), stdout);
+}
+
+} // namespace popvcf
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "reader.hpp"
+
+namespace popvcf
+{
+//! Comparison operators of filter conditions
+enum class CompareOp
+{
+  EQ,
+  NE,
+  LT,
+  LE,
+  GT,
+  GE
+};
+
+//! A condition on a FORMAT subfield of a sample, e.g. GQ>=20 or GT="het".
+class SampleCondition
+{
+public:
+  std::string key{};              //!< FORMAT subfield, e.g. "GQ"
+  CompareOp op{CompareOp::EQ};    //!< Comparison operator
+  std::string value{};            //!< Value to compare with
+  double number{0.0};             //!< Value as a number, if is_numeric
+  bool is_numeric{false};         //!< True iff the value is a number
+  std::vector<int32_t> alleles{}; //!< Alleles of a GT value that is a genotype, e.g. "0/1"
+
+  //! Returns true if the subfield of a sample satisfies the condition.
+  bool evaluate(std::string_view subfield, std::vector<int32_t> & gt_alleles) const;
+};
+
+//! A filter of records parsed from an expression like 'GT="alt" && GQ>=20 && N_PASS>=2'. Conditions on FORMAT
+//! subfields select passing samples, and N_PASS compares the number of passing samples (by default N_PASS>=1). Each
+//! unique genotype field of a record is evaluated once.
+class RecordFilter
+{
+public:
+  //! Parses a filter expression. Throws std::runtime_error if it cannot be parsed.
+  explicit RecordFilter(std::string const & expression);
+
+  //! Returns true if the current record of \a reader passes the filter.
+  bool evaluate(RecordReader const & reader);
+
+  //! Returns the lowest number of non-reference alleles in GT of a record that passes the filter, which is above zero
+  //! if each passing sample must have a non-reference allele, e.g. with GT="alt".
+  uint64_t get_min_alt_count() const;
+
+private:
+  std::vector<SampleCondition> conditions{};
+  CompareOp n_pass_op{CompareOp::GE};
+  long n_pass_value{1};
+
+  std::vector<long> subfield_indices{}; //!< Index of the subfield of each condition in the FORMAT of the record
+  std::vector<char> is_passing{};       //!< True for unique genotype fields that pass the sample conditions
+  std::vector<int32_t> gt_alleles{};    //!< Alleles of the GT subfield that is evaluated
+};
+
+//! Decode the records of a popVCF that pass the filter \a expression. Genotypes of other records are never decoded. If
+//! the popVCF has a zone map, blocks without enough non-reference alleles to pass are skipped without reading them.
+void decode_filtered(std::string const & popvcf_fn,
+                     std::string const & region,
+                     std::string const & expression,
+                     bool const drop_genotypes);
+
+} // namespace popvcf
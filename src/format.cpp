@@ -0,0 +1,102 @@
+#include "format.hpp"
+
+#include <stdexcept>   // std::runtime_error
+#include <string>      // std::string
+#include <string_view> // std::string_view
+
+#include "sequence_utils.hpp" // split_string
+
+namespace popvcf
+{
+namespace
+{
+std::string_view constexpr OPTIONS_KEY{"##popvcfOptions="};
+std::string_view constexpr SEED_KEY{"##popvcfSeed="};
+
+} // namespace
+
+bool FormatOptions::any() const
+{
+  return framed || checksum || packed || allele_history || site_columns || !seeds.empty();
+}
+
+std::string FormatOptions::to_header_line() const
+{
+  std::string line(OPTIONS_KEY);
+
+  if (framed)
+    line.append("framed,");
+
+  if (checksum)
+    line.append("checksum,");
+
+  if (packed)
+    line.append("packed,");
+
+  if (allele_history)
+    line.append("allele_history,");
+
+  if (site_columns)
+    line.append("site_columns,");
+
+  if (!seeds.empty())
+    line.append("seeded,");
+
+  line.back() = '\n'; // replaces the last comma
+
+  for (std::string const & seed : seeds)
+  {
+    line.append(SEED_KEY);
+    line.append(seed);
+    line.push_back('\n');
+  }
+
+  return line;
+}
+
+void FormatOptions::parse_header_line(std::string_view line)
+{
+  if (line.substr(0, SEED_KEY.size()) == SEED_KEY)
+  {
+    seeds.emplace_back(line.substr(SEED_KEY.size()));
+    return;
+  }
+
+  if (line.substr(0, OPTIONS_KEY.size()) != OPTIONS_KEY)
+    return;
+
+  for (std::string_view const option : split_string(line.substr(OPTIONS_KEY.size()), ','))
+  {
+    if (option == "framed")
+    {
+      framed = true;
+    }
+    else if (option == "checksum")
+    {
+      checksum = true;
+    }
+    else if (option == "packed")
+    {
+      packed = true;
+    }
+    else if (option == "allele_history")
+    {
+      allele_history = true;
+    }
+    else if (option == "site_columns")
+    {
+      site_columns = true;
+    }
+    else if (option == "seeded")
+    {
+      // the seeds follow on their own header lines
+    }
+    else
+    {
+      throw std::runtime_error("Unknown popVCF option '" + std::string(option) +
+                               "'. The file may have been encoded with a newer version of popVCF.");
+    }
+  }
+}
+
+} // namespace popvcf
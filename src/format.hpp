@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace popvcf
+{
+//! Header lines starting with this prefix describe the encoding and are not part of the decoded VCF.
+std::string_view constexpr POPVCF_HEADER_PREFIX{"##popvcf"};
+
+//! First character of the genotypes of a packed record, which are encoded as
+//! "!<r><k><packed characters>\t<u_0>[\t<u_1>[\t<u_2>]][\t<escape>]*\n".
+//! Unique genotype fields of the record are numbered in order of first appearance. Each packed character holds the
+//! states of three samples, two bits each, which are the number of the field if it is below three and PACKED_ESCAPE
+//! otherwise. r is the number of samples in the last packed character and k is the number of fields u_0, u_1, ...
+//! that the states refer to. Escapes follow in sample order, each is the field itself if it appears for the first
+//! time, otherwise its number.
+char constexpr PACKED_ROW_MARKER{'!'};
+char constexpr PACKED_CHAR_MIN{'?'}; //!< Packed characters are the 64 characters from '?' to '~'
+uint32_t constexpr PACKED_ESCAPE{3}; //!< State of a sample whose field is written as an escape
+
+//! First character of a genotype field that is the seed with the number that follows, "\"<seed number>". Seeds are
+//! frequent genotype fields listed in the header, which any record can refer to like the fields of the previous record.
+char constexpr SEED_MARKER{'"'};
+std::size_t constexpr MAX_SEEDS{64}; //!< Most seeds a popVCF can have
+
+//! Optional encoding features. Files with no features enabled are identical to files from popVCF v1.
+class FormatOptions
+{
+public:
+  bool framed{false};         //!< Genotypes of each record are prefixed with their encoded length.
+  bool checksum{false};       //!< Genotypes of each record are prefixed with the CRC32 of the decoded block so far.
+  bool packed{false};         //!< Genotypes of biallelic GT-only records are packed, see PACKED_ROW_MARKER.
+  bool allele_history{false}; //!< Records refer to earlier records with as many ALT alleles, see HISTORY_MARKER.
+  bool site_columns{false};   //!< ID, QUAL, FILTER, INFO and FORMAT are encoded against the previous record.
+
+  //! Genotype fields that records refer to with SEED_MARKER, in the order of their numbers.
+  std::vector<std::string> seeds{};
+
+  //! Returns true if any feature is enabled, in which case the options header line must be written.
+  bool any() const;
+
+  //! Returns true if the genotypes of each record are prefixed, e.g. "<length>,<checksum>\t".
+  inline bool has_record_prefix() const
+  {
+    return framed || checksum;
+  }
+
+  //! Returns the "##popvcfOptions=" header line followed by a "##popvcfSeed=" line for each seed, including newlines.
+  std::string to_header_line() const;
+
+  //! Enables the features listed in a header line that starts with POPVCF_HEADER_PREFIX, or adds the seed of a
+  //! "##popvcfSeed=" line. Other lines are ignored. Throws std::runtime_error on options this version does not know.
+  void parse_header_line(std::string_view line);
+};
+
+} // namespace popvcf
@@ -0,0 +1,93 @@
+#include "gather_output.hpp"
+
+#include <algorithm> // std::min
+#include <cerrno>    // errno
+#include <climits>   // IOV_MAX
+#include <cstdlib>   // std::exit
+#include <cstring>   // std::strerror
+#include <iostream>  // std::cerr
+#include <vector>    // std::vector
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace popvcf
+{
+void GatherOutput::release_refs()
+{
+  if (ref_size + staged.size() >= GATHER_MIN_WRITE_SIZE)
+  {
+    flush();
+    return;
+  }
+
+  if (refs.empty())
+    return;
+
+  /// There is too little output to write, copy the ranges so they can change
+  copied.resize(0);
+  std::size_t b{0};
+
+  for (Ref const & ref : refs)
+  {
+    copied.insert(copied.end(), staged.begin() + b, staged.begin() + ref.pos);
+    copied.insert(copied.end(), ref.data, ref.data + ref.size);
+    b = ref.pos;
+  }
+
+  copied.insert(copied.end(), staged.begin() + b, staged.end());
+  staged.swap(copied);
+  refs.resize(0);
+  ref_size = 0;
+}
+
+void GatherOutput::flush()
+{
+  iov.resize(0);
+  std::size_t b{0};
+
+  for (Ref const & ref : refs)
+  {
+    if (ref.pos > b)
+      iov.push_back({staged.data() + b, ref.pos - b});
+
+    iov.push_back({const_cast<char *>(ref.data), ref.size});
+    b = ref.pos;
+  }
+
+  if (staged.size() > b)
+    iov.push_back({staged.data() + b, staged.size() - b});
+
+  /// Write at most IOV_MAX parts at a time and continue after partial writes
+  std::size_t i{0};
+
+  while (i < iov.size())
+  {
+    int const n = std::min<std::size_t>(iov.size() - i, IOV_MAX);
+    ssize_t written = writev(fd, iov.data() + i, n);
+
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      std::cerr << "[popvcf] ERROR: Could not write the output: " << std::strerror(errno) << std::endl;
+      std::exit(1);
+    }
+
+    for (; i < iov.size() && static_cast<std::size_t>(written) >= iov[i].iov_len; ++i)
+      written -= iov[i].iov_len;
+
+    if (written > 0)
+    {
+      iov[i].iov_base = static_cast<char *>(iov[i].iov_base) + written;
+      iov[i].iov_len -= written;
+    }
+  }
+
+  staged.resize(0);
+  refs.resize(0);
+  ref_size = 0;
+}
+
+} // namespace popvcf
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "sequence_utils.hpp" // DEC_BUFFER_SIZE
+
+namespace popvcf
+{
+std::size_t constexpr GATHER_MIN_REF_SIZE{64};                //!< Shortest range that is referred to instead of copied
+std::size_t constexpr GATHER_MIN_WRITE_SIZE{DEC_BUFFER_SIZE}; //!< Output that is written when references are released
+
+//! Decoded output that is written to a file descriptor with writev(). It is used like the std::vector<char> output of
+//! decode_buffer, but ranges that are appended with append_ref() and are at least GATHER_MIN_REF_SIZE long are
+//! referred to where they are instead of being copied. They must stay valid until release_refs() is called, which
+//! writes the output if there is enough of it and otherwise copies the ranges.
+class GatherOutput
+{
+public:
+  explicit GatherOutput(int const fd)
+    : fd(fd)
+  {
+    staged.reserve(2 * GATHER_MIN_WRITE_SIZE);
+  }
+
+  /* The parts of the std::vector<char> interface that decode_buffer uses, which append to the staged output. */
+  inline std::vector<char>::iterator end()
+  {
+    return staged.end();
+  }
+
+  template <typename Tit>
+  inline void insert(std::vector<char>::iterator const pos, Tit const first, Tit const last)
+  {
+    staged.insert(pos, first, last);
+  }
+
+  inline void push_back(char const c)
+  {
+    staged.push_back(c);
+  }
+
+  inline char & back()
+  {
+    return staged.back();
+  }
+
+  //! Appends the range from \a first to \a last, which is referred to if it is long enough.
+  inline void append_ref(char const * first, char const * last)
+  {
+    std::size_t const size = last - first;
+
+    if (size < GATHER_MIN_REF_SIZE)
+    {
+      staged.insert(staged.end(), first, last);
+      return;
+    }
+
+    refs.push_back(Ref{staged.size(), first, size});
+    ref_size += size;
+  }
+
+  //! Called before the ranges that have been referred to may change.
+  void release_refs();
+
+  //! Writes all output.
+  void flush();
+
+private:
+  //! Range that is written before the staged output at pos
+  struct Ref
+  {
+    std::size_t pos;
+    char const * data;
+    std::size_t size;
+  };
+
+  int fd{-1};
+  std::vector<char> staged{};      //!< Output that has been copied
+  std::vector<Ref> refs{};         //!< Ranges that are referred to, in the order of pos
+  std::size_t ref_size{0};         //!< Total size of the ranges that are referred to
+  std::vector<char> copied{};      //!< Staged output with the ranges copied into it
+  std::vector<struct iovec> iov{}; //!< Parts of the output that are written
+};
+
+} // namespace popvcf
@@ -0,0 +1,55 @@
+#include "genotype.hpp"
+
+#include <charconv>    // std::from_chars
+#include <cstdint>     // int32_t
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+namespace popvcf
+{
+std::string_view get_subfield(std::string_view field, long subfield_index)
+{
+  std::size_t b{0};
+
+  for (; subfield_index > 0; --subfield_index)
+  {
+    b = field.find(':', b);
+
+    if (b == std::string_view::npos)
+      return std::string_view();
+
+    ++b;
+  }
+
+  std::size_t const e = field.find(':', b);
+  return field.substr(b, e == std::string_view::npos ? std::string_view::npos : e - b);
+}
+
+void parse_gt(std::string_view field, std::vector<int32_t> & alleles)
+{
+  alleles.resize(0);
+  std::string_view const gt = get_subfield(field, 0);
+  char const * it = gt.data();
+  char const * const end = gt.data() + gt.size();
+
+  while (it < end)
+  {
+    int32_t allele{MISSING_ALLELE};
+
+    if (*it == '.')
+      ++it;
+    else
+      it = std::from_chars(it, end, allele).ptr;
+
+    alleles.push_back(allele);
+
+    /// skip the phasing character, or anything else that is not an allele
+    while (it < end && (*it == '/' || *it == '|'))
+      ++it;
+
+    if (it < end && *it != '.' && (*it < '0' || *it > '9'))
+      break;
+  }
+}
+
+} // namespace popvcf
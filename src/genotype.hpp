@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace popvcf
+{
+int32_t constexpr MISSING_ALLELE{-1}; //!< Allele index of '.' in GT
+
+//! Returns the subfield with index \a subfield_index in a genotype field, or an empty view if the field has fewer.
+std::string_view get_subfield(std::string_view field, long subfield_index);
+
+//! Parses the GT subfield, which must be first in the genotype field. Missing alleles are MISSING_ALLELE.
+void parse_gt(std::string_view field, std::vector<int32_t> & alleles);
+
+} // namespace popvcf
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <parallel_hashmap/phmap.h>
+
+namespace popvcf
+{
+//! First character of the token before the genotypes of a record that refers to an earlier record than the previous
+//! one, "'<k>\t" where k is how many records back it is. Only used with the allele_history option.
+char constexpr HISTORY_MARKER{'\''};
+std::size_t constexpr HISTORY_SIZE{4}; //!< Number of earlier records a record can refer to
+
+//! Genotype fields of a record in the history
+class HistoryRow
+{
+public:
+  std::vector<std::string> unique_fields{};
+  std::vector<uint32_t> field2uid{};
+  phmap::flat_hash_map<std::string, uint32_t> map_to_unique_fields{};
+  int32_t n_alt{-1};
+};
+
+//! The last records before the current one. With the allele_history option, a record refers to the latest of them
+//! with the same number of ALT alleles, or to the previous record if there is none. The record that is referred to is
+//! lent to the prev_* fields of the encode or decode data by swapping, so nothing is copied.
+class RowHistory
+{
+public:
+  //! Moves the genotype fields of the record that ended into the history. Nothing may be lent.
+  template <typename Tdata>
+  inline void push(Tdata & data)
+  {
+    assert(lent == NOT_LENT);
+    newest = (newest + 1) % HISTORY_SIZE;
+    HistoryRow & row = rows[newest];
+    std::swap(row.unique_fields, data.unique_fields);
+    std::swap(row.field2uid, data.field2uid);
+    std::swap(row.map_to_unique_fields, data.map_to_unique_fields);
+    row.n_alt = data.n_alt;
+    n_rows = std::min(n_rows + 1, HISTORY_SIZE);
+  }
+
+  //! Forgets all records, e.g. at the start of a block.
+  inline void clear()
+  {
+    n_rows = 0;
+  }
+
+  //! Returns how many records back the latest record with \a n_alt ALT alleles is, 1 if there is no such record and
+  //! 0 if the history is empty.
+  inline uint32_t find(int32_t const n_alt) const
+  {
+    for (std::size_t k{1}; k <= n_rows; ++k)
+    {
+      if (rows[get_index(k)].n_alt == n_alt)
+        return k;
+    }
+
+    return n_rows > 0 ? 1 : 0;
+  }
+
+  //! Lends the record \a k records back to the prev_* fields of \a data. If \a k is 0 they are cleared.
+  template <typename Tdata>
+  inline void lend(Tdata & data, uint32_t const k)
+  {
+    assert(lent == NOT_LENT);
+    assert(k <= n_rows);
+
+    if (k == 0)
+    {
+      data.prev_unique_fields.resize(0);
+      data.prev_field2uid.resize(0);
+      data.prev_map_to_unique_fields.clear();
+      return;
+    }
+
+    lent = get_index(k);
+    swap_prev(data, rows[lent]);
+  }
+
+  //! Takes back the record that is lent to \a data, if any.
+  template <typename Tdata>
+  inline void give_back(Tdata & data)
+  {
+    if (lent != NOT_LENT)
+    {
+      swap_prev(data, rows[lent]);
+      lent = NOT_LENT;
+    }
+  }
+
+private:
+  static long constexpr NOT_LENT{-1};
+
+  std::array<HistoryRow, HISTORY_SIZE> rows{};
+  std::size_t newest{0}; //!< Index of the newest record in rows
+  std::size_t n_rows{0}; //!< Number of records in the history
+  long lent{NOT_LENT};   //!< Index of the record that is lent to the prev_* fields
+
+  inline long get_index(std::size_t const k) const
+  {
+    return static_cast<long>((newest + HISTORY_SIZE - (k - 1)) % HISTORY_SIZE);
+  }
+
+  template <typename Tdata>
+  static inline void swap_prev(Tdata & data, HistoryRow & row)
+  {
+    std::swap(data.prev_unique_fields, row.unique_fields);
+    std::swap(data.prev_field2uid, row.field2uid);
+    std::swap(data.prev_map_to_unique_fields, row.map_to_unique_fields);
+  }
+};
+
+} // namespace popvcf
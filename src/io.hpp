@@ -1,10 +1,15 @@
 #pragma once
 
+#include <cassert>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
 #include <string>
 
+#include <sys/stat.h>
+
 #include "htslib/bgzf.h"
 #include "htslib/hts.h"
 #include "htslib/kseq.h"
@@ -69,6 +74,29 @@ inline void write_bgzf(BGZF * bgzf, const char * data, std::size_t const size)
   }
 }
 
+//! Reads up to \a size bytes from \a bgzf and returns how many were read. Exits if reading fails.
+inline std::size_t read_bgzf(BGZF * bgzf, char * data, std::size_t const size)
+{
+  ssize_t const read_bytes = bgzf_read(bgzf, data, size);
+
+  if (read_bytes < 0)
+  {
+    std::cerr << "[popvcf] ERROR: Failed reading bgzf data." << std::endl;
+    std::exit(1);
+  }
+
+  return read_bytes;
+}
+
+//! Writes to \a bgzf if it is open, otherwise to \a f
+inline void write_output(BGZF * bgzf, FILE * f, const char * data, std::size_t const size)
+{
+  if (bgzf != nullptr)
+    write_bgzf(bgzf, data, size);
+  else
+    fwrite(data, 1, size, f);
+}
+
 inline void close_bgzf(BGZF * bgzf)
 {
   if (bgzf != nullptr)
@@ -159,4 +187,32 @@ inline void free_kstring_t(kstring_t * str)
   if (str->s != NULL)
     free(str->s);
 }
+
+//! Returns the size of the file \a fn, exits if it cannot be read.
+inline uint64_t get_file_size(std::string const & fn)
+{
+  struct stat file_stat;
+
+  if (stat(fn.c_str(), &file_stat) != 0)
+  {
+    std::cerr << "[popvcf] ERROR: Could not read the size of " << fn << std::endl;
+    std::exit(1);
+  }
+
+  return file_stat.st_size;
+}
+
+//! Returns the modification time of the file \a fn in seconds since the epoch, exits if it cannot be read.
+inline int64_t get_file_mtime(std::string const & fn)
+{
+  struct stat file_stat;
+
+  if (stat(fn.c_str(), &file_stat) != 0)
+  {
+    std::cerr << "[popvcf] ERROR: Could not read the modification time of " << fn << std::endl;
+    std::exit(1);
+  }
+
+  return file_stat.st_mtime;
+}
 } // namespace popvcf
@@ -1,11 +1,25 @@
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <paw/parser.hpp>
 
+#include "add_samples.hpp"
+#include "block_index.hpp"
+#include "compare.hpp"
+#include "concat.hpp"
 #include "decode.hpp"
 #include "encode.hpp"
+#include "export.hpp"
+#include "filter.hpp"
+#include "format.hpp"
+#include "serve.hpp"
+#include "split.hpp"
+#include "stats.hpp"
+#include "verify.hpp"
+#include "view.hpp"
 
 #include <popvcf/constants.hpp>
 
@@ -20,6 +34,16 @@ int subcmd_encode(paw::Parser & parser)
   std::string output_type{"v"};
   int output_compress_level{-1};
   int compression_threads{1};
+  int row_threads{1};
+  bool is_paste{false};
+  bool write_zone_map{false};
+  std::string seeds_fn{};
+  bool is_learning_seeds{false};
+  int checkpoint_mb{0};
+  bool is_resume{false};
+  bool is_verify{false};
+  std::vector<std::string> paste_fns{};
+  FormatOptions options;
 
   try
   {
@@ -48,6 +72,88 @@ int subcmd_encode(paw::Parser & parser)
     parser.parse_option(output_compress_level, 'l', "output-compress-level", "Output file compression level.", "LEVEL");
 
     parser.parse_option(output_type, 'O', "output-type", "Output type. v uncompressed VCF, z bgzipped VCF.", "v|z");
+
+    parser.parse_option(options.framed,
+                        'F',
+                        "framed",
+                        "Prefix the genotypes of each record with their encoded length, which allows "
+                        "'decode --drop-genotypes' to skip them without parsing.");
+
+    parser.parse_option(options.checksum,
+                        'C',
+                        "checksum",
+                        "Prefix the genotypes of each record with a CRC32 of the decoded block up to and including the "
+                        "record, which 'popvcf verify' checks.");
+
+    parser.parse_option(options.packed,
+                        'P',
+                        "packed",
+                        "Pack the genotypes of records with a single ALT allele and FORMAT GT, using two bits per "
+                        "sample for the first three distinct genotypes of the record. Later genotypes are escaped.");
+
+    parser.parse_option(options.allele_history,
+                        'A',
+                        "allele-history",
+                        "Let the genotypes of each record refer to the latest of the last 4 records of the block with "
+                        "the same number of ALT alleles, instead of only to the previous record.");
+
+    parser.parse_option(options.site_columns,
+                        'X',
+                        "site-columns",
+                        "Encode ID, QUAL, FILTER, INFO and FORMAT against the previous record of the block. Columns "
+                        "and INFO entries that are the same are left out, and INFO values are written without their "
+                        "key.");
+
+    parser.parse_option(row_threads,
+                        'T',
+                        "row-threads",
+                        "Number of threads that encode the genotypes of each row with more than 256 KB of them.",
+                        "NUM");
+
+    parser.parse_option(is_paste,
+                        'p',
+                        "paste",
+                        "Encode several VCFs with the same records and different samples, as if their genotype columns "
+                        "were pasted side by side.");
+
+    parser.parse_option(seeds_fn,
+                        'S',
+                        "seeds",
+                        "File with up to 64 frequent genotype fields, one per line, that records can refer to like "
+                        "fields of the previous record. This helps the first record of each block.",
+                        "FILE");
+
+    parser.parse_option(is_learning_seeds,
+                        'L',
+                        "learn-seeds",
+                        "Use the genotype fields that are in the most of the first 1000 records of the VCF as seeds.");
+
+    parser.parse_option(write_zone_map,
+                        'Z',
+                        "zone-map",
+                        "Write a summary of each block to output.pzm, which lets 'decode --include' skip blocks. "
+                        "Bgzipped output also gets a .gzi index.");
+
+    parser.parse_option(checkpoint_mb,
+                        'K',
+                        "checkpoint",
+                        "Save a checkpoint to output.ckpt at the first block after every MB megabytes of input, from "
+                        "which an interrupted encoding continues with --resume.",
+                        "MB");
+
+    parser.parse_option(is_resume,
+                        'R',
+                        "resume",
+                        "Continue the encoding of the output from output.ckpt. The same VCF, options and output type "
+                        "must be given, and the output after the checkpoint is replaced.");
+
+    parser.parse_option(is_verify,
+                        'V',
+                        "verify",
+                        "Decode the output on another thread while encoding and exit with an error if it does not "
+                        "decode to the input.");
+
+    parser.parse_remaining_positional_arguments(paste_fns, "VCF...", "More VCFs to paste with --paste.");
     parser.finalize();
   }
   catch (paw::exception::missing_positional_argument &)
@@ -58,12 +164,65 @@ int subcmd_encode(paw::Parser & parser)
   if (output_compress_level >= 0)
     output_mode += std::to_string(std::min(9, output_compress_level));
 
+  if (write_zone_map && (output_fn == "-" || is_paste))
+  {
+    std::cerr << "[popvcf] ERROR: --zone-map requires an output file and cannot be combined with --paste." << std::endl;
+    return 1;
+  }
+
+  if ((checkpoint_mb > 0 || is_resume) && (output_fn == "-" || is_paste || write_zone_map))
+  {
+    std::cerr << "[popvcf] ERROR: --checkpoint and --resume require an output file and cannot be combined with "
+              << "--paste or --zone-map." << std::endl;
+    return 1;
+  }
+
+  if (is_verify && is_paste)
+  {
+    std::cerr << "[popvcf] ERROR: --verify cannot be combined with --paste." << std::endl;
+    return 1;
+  }
+
+  if (is_learning_seeds && (!seeds_fn.empty() || vcf_fn == "-"))
+  {
+    std::cerr << "[popvcf] ERROR: --learn-seeds requires a VCF file and cannot be combined with --seeds." << std::endl;
+    return 1;
+  }
+
+  if (is_learning_seeds)
+    options.seeds = learn_seeds(vcf_fn);
+  else if (!seeds_fn.empty())
+    options.seeds = read_seeds(seeds_fn);
+
+  if (is_paste)
+  {
+    paste_fns.insert(paste_fns.begin(), vcf_fn);
+    encode_paste(paste_fns, output_fn, output_mode, output_type == "z", compression_threads, row_threads, options);
+    return 0;
+  }
+  else if (paste_fns.size() > 0)
+  {
+    std::cerr << "[popvcf] ERROR: Several VCFs are only encoded with --paste." << std::endl;
+    return 1;
+  }
+
   long const n = vcf_fn.size();
 
   if (n > 3 && vcf_fn[n - 2] == 'g' && vcf_fn[n - 1] == 'z')
     input_type = "z";
 
-  encode_file(vcf_fn, input_type == "z", output_fn, output_mode, output_type == "z", compression_threads);
+  encode_file(vcf_fn,
+              input_type == "z",
+              output_fn,
+              output_mode,
+              output_type == "z",
+              compression_threads,
+              row_threads,
+              write_zone_map,
+              options,
+              static_cast<uint64_t>(std::max(0, checkpoint_mb)) << 20,
+              is_resume,
+              is_verify);
   return 0;
 }
 
@@ -72,6 +231,10 @@ int subcmd_decode(paw::Parser & parser)
   std::string popvcf_fn{};
   std::string input_type{"g"};
   std::string region{};
+  std::string include{};
+  std::string positions_fn{};
+  bool drop_genotypes{false};
+  bool is_writev{false};
 
   try
   {
@@ -80,7 +243,39 @@ int subcmd_decode(paw::Parser & parser)
                         "input-type",
                         "Input type. v uncompressed VCF, z bgzipped VCF, g guess based on filename.",
                         "v|z|g");
-    parser.parse_option(region, 'r', "region", "Fetch region/interval to decode. Requires .tbi index.", "chrN:A-B");
+    parser.parse_option(region,
+                        'r',
+                        "region",
+                        "Fetch region/interval to decode. Requires a .pvi index from 'popvcf index' or a .tbi index.",
+                        "chrN:A-B");
+
+    parser.parse_option(positions_fn,
+                        'P',
+                        "positions",
+                        "Decode the records at the positions in this file, in a single pass. Each line has a contig, a "
+                        "position and optionally REF and ALT, separated by tabs and sorted by position. Requires .tbi "
+                        "index.",
+                        "FILE");
+
+    parser.parse_option(drop_genotypes,
+                        'G',
+                        "drop-genotypes",
+                        "Only decode the first eight columns (CHROM to INFO) of each record.");
+
+    parser.parse_option(is_writev,
+                        'W',
+                        "writev",
+                        "Write the output with writev from the decoding thread, referring to long genotype fields "
+                        "instead of copying them. Only used when the whole popVCF is decoded.");
+
+    parser.parse_option(include,
+                        'i',
+                        "include",
+                        "Only decode records that pass this filter, e.g. 'GT=\"alt\" && GQ>=20 && N_PASS>=2'. "
+                        "Conditions on FORMAT subfields select samples (GT can be ref, alt, het, hom, miss or a "
+                        "genotype) and N_PASS compares the number of selected samples (default N_PASS>=1).",
+                        "EXPR");
+
     parser.parse_positional_argument(popvcf_fn, "popVCF", "Decode this popVCF. Use '-' for standard input.");
     parser.finalize();
   }
@@ -94,11 +289,265 @@ int subcmd_decode(paw::Parser & parser)
   if (input_type == "g" && n > 3 && popvcf_fn[n - 2] == 'g' && popvcf_fn[n - 1] == 'z')
     input_type = "z";
 
-  if (region.empty())
-    decode_file(popvcf_fn, input_type == "z");
+  if (!positions_fn.empty() && (!region.empty() || !include.empty()))
+  {
+    std::cerr << "[popvcf] ERROR: --positions cannot be combined with --region or --include." << std::endl;
+    return 1;
+  }
+
+  if (!positions_fn.empty())
+    decode_positions(popvcf_fn, positions_fn, drop_genotypes);
+  else if (!include.empty())
+    decode_filtered(popvcf_fn, region, include, drop_genotypes);
+  else if (region.empty())
+    decode_file(popvcf_fn, input_type == "z", drop_genotypes, is_writev);
   else
-    decode_region(popvcf_fn, region);
+    decode_region(popvcf_fn, region, drop_genotypes);
+
+  return 0;
+}
+
+int subcmd_concat(paw::Parser & parser)
+{
+  std::vector<std::string> popvcf_fns;
+  std::string output_fn{"-"};
+  bool write_index{false};
+
+  parser.parse_option(output_fn,
+                      'o',
+                      "output",
+                      "Output will be written to this path. If '-', then write instead to standard output.",
+                      "output.popvcf.gz");
+
+  parser.parse_option(write_index, 'W', "write-index", "Build a tabix index for the output file.");
+  parser.parse_remaining_positional_arguments(popvcf_fns, "popVCF...", "Bgzipped popVCF files to concatenate.");
+  parser.finalize();
+
+  if (popvcf_fns.empty())
+  {
+    std::cerr << "[popvcf] ERROR: No input files given." << std::endl;
+    return 1;
+  }
 
+  concat_files(popvcf_fns, output_fn, write_index);
+  return 0;
+}
+
+int subcmd_view(paw::Parser & parser)
+{
+  std::string popvcf_fn{};
+  std::string region{};
+  std::string output_fn{"-"};
+  std::string output_mode{"w"};
+  std::string output_type{"v"};
+  int output_compress_level{-1};
+  int compression_threads{1};
+  bool write_index{false};
+
+  parser.parse_option(compression_threads,
+                      '@',
+                      "threads",
+                      "Number of output file compression threads (only used if output type is \"z\").",
+                      "NUM");
+
+  parser.parse_option(output_fn,
+                      'o',
+                      "output",
+                      "Output will be written to this path. If '-', then write instead to standard output.",
+                      "output.popvcf[.gz]");
+
+  parser.parse_option(output_compress_level, 'l', "output-compress-level", "Output file compression level.", "LEVEL");
+  parser.parse_option(output_type, 'O', "output-type", "Output type. v uncompressed popVCF, z bgzipped popVCF.", "v|z");
+  parser.parse_option(region, 'r', "region", "Region/interval to extract. Requires .tbi index.", "chrN:A-B");
+  parser.parse_option(write_index, 'W', "write-index", "Build a tabix index for the output file.");
+  parser.parse_positional_argument(popvcf_fn, "popVCF", "Bgzipped and tabix indexed popVCF to extract from.");
+  parser.finalize();
+
+  if (region.empty())
+  {
+    std::cerr << "[popvcf] ERROR: A region is required, use --region." << std::endl;
+    return 1;
+  }
+
+  if (output_compress_level >= 0)
+    output_mode += std::to_string(std::min(9, output_compress_level));
+
+  view_region(popvcf_fn, region, output_fn, output_mode, output_type == "z", compression_threads, write_index);
+  return 0;
+}
+
+int subcmd_stats(paw::Parser & parser)
+{
+  std::string popvcf_fn{"-"};
+  std::string samples_fn{};
+  bool allele_frequencies{false};
+
+  try
+  {
+    parser.parse_option(allele_frequencies,
+                        'a',
+                        "af",
+                        "Write genotype counts, AC, AN, AF and the fraction of missing genotypes of each record.");
+
+    parser.parse_option(samples_fn, 'S', "samples-file", "Only count the samples listed in this file.", "FILE");
+    parser.parse_positional_argument(popvcf_fn,
+                                     "popVCF",
+                                     "Compute statistics of this popVCF. Use '-' for standard input.");
+    parser.finalize();
+  }
+  catch (paw::exception::missing_positional_argument &)
+  {
+    popvcf_fn = "-";
+  }
+
+  stats_file(popvcf_fn, allele_frequencies, samples_fn);
+  return 0;
+}
+
+int subcmd_verify(paw::Parser & parser)
+{
+  std::string popvcf_fn{"-"};
+  int threads{1};
+
+  try
+  {
+    parser.parse_option(threads, '@', "threads", "Number of threads that decode and check blocks.", "NUM");
+    parser.parse_positional_argument(popvcf_fn, "popVCF", "Verify this popVCF. Use '-' for standard input.");
+    parser.finalize();
+  }
+  catch (paw::exception::missing_positional_argument &)
+  {
+    popvcf_fn = "-";
+  }
+
+  return verify_file(popvcf_fn, threads) == 0 ? 0 : 1;
+}
+
+int subcmd_serve(paw::Parser & parser)
+{
+  std::string popvcf_fn{};
+  std::string socket_path{"popvcf.sock"};
+  long cache_size{256};
+
+  parser.parse_option(socket_path, 's', "socket", "Listen for queries on this Unix socket.", "PATH");
+  parser.parse_option(cache_size, 'm', "cache-size", "Megabytes of decoded blocks to keep in memory.", "MB");
+  parser.parse_positional_argument(popvcf_fn, "popVCF", "Serve this bgzipped popVCF. Requires .tbi index.");
+  parser.finalize();
+
+  serve_file(popvcf_fn, socket_path, cache_size);
+  return 0;
+}
+
+int subcmd_add_samples(paw::Parser & parser)
+{
+  std::string popvcf_fn{};
+  std::string vcf_fn{};
+  std::string output_fn{"-"};
+  std::string output_type{"v"};
+  int threads{1};
+
+  parser.parse_option(threads, '@', "threads", "Number of threads that add samples to blocks.", "NUM");
+
+  parser.parse_option(output_fn,
+                      'o',
+                      "output",
+                      "Output will be written to this path. If '-', then write instead to standard output.",
+                      "output.popvcf[.gz]");
+
+  parser.parse_option(output_type, 'O', "output-type", "Output type. v uncompressed popVCF, z bgzipped popVCF.", "v|z");
+  parser.parse_positional_argument(popvcf_fn, "popVCF", "Add samples to this popVCF.");
+  parser.parse_positional_argument(vcf_fn, "VCF", "VCF with the new samples and the same records as the popVCF.");
+  parser.finalize();
+
+  add_samples(popvcf_fn, vcf_fn, output_fn, output_type == "z", threads);
+  return 0;
+}
+
+int subcmd_export(paw::Parser & parser)
+{
+  std::string popvcf_fn{"-"};
+  std::string plink_prefix{};
+  std::string region{};
+
+  parser.parse_option(plink_prefix,
+                      'p',
+                      "plink",
+                      "Write the biallelic records as PLINK 1 binary files PREFIX.bed, PREFIX.bim and PREFIX.fam.",
+                      "PREFIX");
+
+  parser.parse_option(region, 'r', "region", "Export only this region. Requires .tbi index.", "chrN:A-B");
+  parser.parse_positional_argument(popvcf_fn, "popVCF", "Export this popVCF.");
+  parser.finalize();
+
+  if (plink_prefix.empty())
+  {
+    std::cerr << "[popvcf] ERROR: An output format is required, e.g. --plink=PREFIX" << std::endl;
+    return 1;
+  }
+
+  export_plink(popvcf_fn, region, plink_prefix);
+  return 0;
+}
+
+int subcmd_compare(paw::Parser & parser)
+{
+  std::string popvcf_fn_a{};
+  std::string popvcf_fn_b{};
+  std::string per_sample_fn{};
+
+  parser.parse_option(per_sample_fn, 's', "per-sample", "Write the concordance of each sample to this file.", "FILE");
+  parser.parse_positional_argument(popvcf_fn_a, "popVCF_A", "Compare this popVCF...");
+  parser.parse_positional_argument(popvcf_fn_b, "popVCF_B", "...to this popVCF.");
+  parser.finalize();
+
+  compare_files(popvcf_fn_a, popvcf_fn_b, per_sample_fn);
+  return 0;
+}
+
+int subcmd_split(paw::Parser & parser)
+{
+  std::string popvcf_fn{};
+  std::string prefix{};
+  int n_shards{0};
+  int target_size_mb{0};
+
+  parser.parse_option(prefix,
+                      'o',
+                      "output-prefix",
+                      "Write the shards to PREFIX.<shard>.popvcf.gz, each with a tabix index.",
+                      "PREFIX");
+
+  parser.parse_option(n_shards, 'n', "shards", "Number of shards to split into.", "N");
+
+  parser.parse_option(target_size_mb,
+                      's',
+                      "target-size",
+                      "Split into shards of about this many megabytes instead of a number of shards.",
+                      "MB");
+
+  parser.parse_positional_argument(popvcf_fn, "popVCF", "Bgzipped popVCF to split.");
+  parser.finalize();
+
+  if (prefix.empty() || (n_shards > 0) == (target_size_mb > 0))
+  {
+    std::cerr << "[popvcf] ERROR: An output prefix and either --shards or --target-size are required." << std::endl;
+    return 1;
+  }
+
+  split_file(popvcf_fn, prefix, n_shards, static_cast<uint64_t>(target_size_mb) << 20);
+  return 0;
+}
+
+int subcmd_index(paw::Parser & parser)
+{
+  std::string popvcf_fn{};
+  int threads{1};
+
+  parser.parse_option(threads, '@', "threads", "Number of threads that scan or decompress the popVCF.", "NUM");
+  parser.parse_positional_argument(popvcf_fn, "popVCF", "Index this plain or bgzipped popVCF.");
+  parser.finalize();
+
+  index_file(popvcf_fn, threads);
   return 0;
 }
 
@@ -120,6 +569,16 @@ int main(int argc, char ** argv)
 
     parser.add_subcommand("encode", "Encode a VCF into a popVCF.");
     parser.add_subcommand("decode", "Decode a popVCF into a VCF.");
+    parser.add_subcommand("concat", "Concatenate bgzipped popVCF files without decoding them.");
+    parser.add_subcommand("view", "Extract a region of a popVCF into a new popVCF.");
+    parser.add_subcommand("stats", "Count genotypes and compute allele frequencies without decoding them.");
+    parser.add_subcommand("verify", "Check the checksums of every block of a popVCF in parallel.");
+    parser.add_subcommand("serve", "Answer region and sample queries on a popVCF over a Unix socket.");
+    parser.add_subcommand("add-samples", "Add the samples of a VCF to a popVCF without re-encoding it.");
+    parser.add_subcommand("export", "Export the genotypes of a popVCF to PLINK without decoding them.");
+    parser.add_subcommand("compare", "Compute the genotype concordance of two popVCFs without decoding them.");
+    parser.add_subcommand("split", "Split a bgzipped popVCF into shards of balanced size without decoding it.");
+    parser.add_subcommand("index", "Index the blocks of a plain or bgzipped popVCF for decoding regions.");
 
     parser.parse_subcommand(subcmd);
 
@@ -131,6 +590,46 @@ int main(int argc, char ** argv)
     {
       ret = popvcf::subcmd_decode(parser);
     }
+    else if (subcmd == "concat")
+    {
+      ret = popvcf::subcmd_concat(parser);
+    }
+    else if (subcmd == "view")
+    {
+      ret = popvcf::subcmd_view(parser);
+    }
+    else if (subcmd == "stats")
+    {
+      ret = popvcf::subcmd_stats(parser);
+    }
+    else if (subcmd == "verify")
+    {
+      ret = popvcf::subcmd_verify(parser);
+    }
+    else if (subcmd == "serve")
+    {
+      ret = popvcf::subcmd_serve(parser);
+    }
+    else if (subcmd == "add-samples")
+    {
+      ret = popvcf::subcmd_add_samples(parser);
+    }
+    else if (subcmd == "export")
+    {
+      ret = popvcf::subcmd_export(parser);
+    }
+    else if (subcmd == "compare")
+    {
+      ret = popvcf::subcmd_compare(parser);
+    }
+    else if (subcmd == "split")
+    {
+      ret = popvcf::subcmd_split(parser);
+    }
+    else if (subcmd == "index")
+    {
+      ret = popvcf::subcmd_index(parser);
+    }
     else if (subcmd.size() == 0)
     {
       parser.finalize();
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+#include "spsc_queue.hpp"
+
+namespace popvcf
+{
+//! A buffer passed between the stages of a pipeline
+class PipelineBuffer
+{
+public:
+  std::vector<char> data{}; //!< Buffer data. Input buffers keep their full size, output buffers their used size
+  std::size_t size{0};      //!< Bytes used in an input buffer
+  bool is_last{false};      //!< True for the buffer that ends the stream
+};
+
+//! Runs reading, coding and writing in three threads, connected by single-producer/single-consumer queues that
+//! recycle a fixed number of buffers.
+//!
+//! \a read(data, max_size) fills an input buffer and returns the number of bytes read, 0 at the end of input.
+//! \a code(data, size, buffer_out) appends the coded input to buffer_out. It is called a last time with size 0.
+//! \a write(data, size) writes an output buffer.
+//! If \a code throws, the reader is stopped, the output coded so far is written and the exception is rethrown.
+template <typename Tread, typename Tcode, typename Twrite>
+void run_pipeline(std::size_t const buffer_size, Tread && read, Tcode && code, Twrite && write)
+{
+  std::size_t constexpr N_BUFFERS{4}; // buffers of each kind
+  SpscQueue<PipelineBuffer> free_in(N_BUFFERS);
+  SpscQueue<PipelineBuffer> full_in(N_BUFFERS);
+  SpscQueue<PipelineBuffer> free_out(N_BUFFERS);
+  SpscQueue<PipelineBuffer> full_out(N_BUFFERS);
+
+  for (std::size_t b{0}; b < N_BUFFERS; ++b)
+  {
+    PipelineBuffer buffer_in;
+    buffer_in.data.resize(buffer_size);
+    free_in.push(buffer_in);
+
+    PipelineBuffer buffer_out;
+    buffer_out.data.reserve(2 * buffer_size);
+    free_out.push(buffer_out);
+  }
+
+  std::atomic<bool> is_cancelled{false};
+
+  std::thread reader(
+    [&]()
+    {
+      bool is_last{false};
+
+      while (!is_last)
+      {
+        PipelineBuffer buffer = free_in.pop();
+        buffer.size = is_cancelled.load(std::memory_order_relaxed) ? 0 : read(buffer.data.data(), buffer.data.size());
+        buffer.is_last = is_last = buffer.size == 0;
+        full_in.push(buffer);
+      }
+    });
+
+  std::thread writer(
+    [&]()
+    {
+      bool is_last{false};
+
+      while (!is_last)
+      {
+        PipelineBuffer buffer = full_out.pop();
+        write(buffer.data.data(), buffer.data.size());
+        is_last = buffer.is_last;
+        free_out.push(buffer);
+      }
+    });
+
+  /// The calling thread codes
+  bool is_last{false};
+  bool is_input_done{false};
+  std::exception_ptr error{nullptr};
+
+  while (!is_last)
+  {
+    PipelineBuffer buffer_in = full_in.pop();
+    is_input_done = buffer_in.is_last;
+    PipelineBuffer buffer_out = free_out.pop();
+    buffer_out.data.resize(0);
+
+    try
+    {
+      code(buffer_in.data.data(), buffer_in.size, buffer_out.data);
+    }
+    catch (...)
+    {
+      error = std::current_exception();
+      is_cancelled = true;
+    }
+
+    buffer_out.is_last = is_last = buffer_in.is_last || error != nullptr;
+    free_in.push(buffer_in);
+    full_out.push(buffer_out);
+  }
+
+  /// Drain the input until the reader has stopped
+  while (!is_input_done)
+  {
+    PipelineBuffer buffer_in = full_in.pop();
+    is_input_done = buffer_in.is_last;
+    free_in.push(buffer_in);
+  }
+
+  reader.join();
+  writer.join();
+
+  if (error != nullptr)
+    std::rethrow_exception(error);
+}
+
+} // namespace popvcf
@@ -0,0 +1,191 @@
+#include "reader.hpp"
+
+#include <cassert>     // assert
+#include <cstdio>      // SEEK_SET
+#include <cstdlib>     // free
+#include <stdexcept>   // std::runtime_error
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+#include "decode.hpp"
+#include "io.hpp"
+#include "sequence_utils.hpp" // split_string, parse_region, get_block_region, get_vcf_pos
+
+#include "htslib/bgzf.h"
+#include "htslib/hts.h"
+#include "htslib/kstring.h"
+#include "htslib/tbx.h"
+
+namespace popvcf
+{
+RecordReader::RecordReader(std::string const & popvcf_fn, std::string const & region)
+  : in_bgzf(nullptr, popvcf::close_bgzf)
+  , in_hts(nullptr, popvcf::close_hts_file)
+  , in_tbx(nullptr, popvcf::close_tbx_t)
+  , in_itr(nullptr, popvcf::close_hts_itr_t)
+  , is_region(!region.empty())
+{
+  dd.write_genotypes = false;
+
+  if (is_region)
+  {
+    std::string chrom;
+    parse_region(region, chrom, begin, end);
+    std::string const safe_region = get_block_region(chrom, begin, end, safe_begin);
+
+    in_hts = popvcf::open_hts_file(popvcf_fn.c_str(), "r");
+    in_tbx = popvcf::open_tbx_t(popvcf_fn.c_str());
+    in_itr = popvcf::open_hts_itr_t(in_tbx.get(), safe_region.c_str());
+    is_done = in_itr == nullptr;
+
+    while (hts_getline(in_hts.get(), KS_SEP_LINE, &str) >= 0)
+    {
+      if (str.l == 0 || str.s[0] != in_tbx->conf.meta_char)
+        break; // the iterator reads the records
+
+      buffer_in.assign(str.s, str.s + str.l);
+      buffer_in.push_back('\n');
+      decode_buffer</*is_region=*/false>(header, buffer_in, dd);
+    }
+  }
+  else
+  {
+    in_bgzf = popvcf::open_bgzf(popvcf_fn, "r"); // bgzf also reads files that are not compressed
+
+    while (bgzf_getline(in_bgzf.get(), '\n', &str) >= 0)
+    {
+      buffer_in.assign(str.s, str.s + str.l);
+      buffer_in.push_back('\n');
+
+      if (str.l == 0 || str.s[0] != '#')
+      {
+        is_pending = true;
+        break;
+      }
+
+      decode_buffer</*is_region=*/false>(header, buffer_in, dd);
+    }
+  }
+}
+
+RecordReader::~RecordReader()
+{
+  free(str.s);
+}
+
+bool RecordReader::read_line()
+{
+  if (is_region)
+    return tbx_itr_next(in_hts.get(), in_tbx.get(), in_itr.get(), &str) > 0;
+  else
+    return bgzf_getline(in_bgzf.get(), '\n', &str) >= 0;
+}
+
+bool RecordReader::next()
+{
+  while (!is_done)
+  {
+    if (!is_pending)
+    {
+      if (!read_line())
+        break;
+
+      buffer_in.assign(str.s, str.s + str.l);
+      buffer_in.push_back('\n');
+    }
+
+    is_pending = false;
+
+    if (!is_region)
+    {
+      site.resize(0);
+      decode_buffer</*is_region=*/false>(site, buffer_in, dd);
+      return true;
+    }
+
+    long const vcf_pos = get_vcf_pos(str.s, str.s + str.l);
+
+    if (vcf_pos > end)
+      break;
+
+    if (vcf_pos < safe_begin)
+    {
+      buffer_in.resize(0); // overlaps the region but starts in an earlier block
+      continue;
+    }
+
+    /// Records before the region begin are decoded since later records may refer to them
+    site.resize(0);
+    decode_buffer</*is_region=*/false>(site, buffer_in, dd);
+
+    if (vcf_pos >= begin)
+      return true;
+  }
+
+  is_done = true;
+  return false;
+}
+
+bool RecordReader::load_gzi(std::string const & popvcf_fn)
+{
+  assert(!is_region);
+  return !in_bgzf->is_compressed || bgzf_index_load(in_bgzf.get(), popvcf_fn.c_str(), ".gzi") == 0;
+}
+
+void RecordReader::seek(uint64_t const offset)
+{
+  assert(!is_region);
+
+  if (bgzf_useek(in_bgzf.get(), offset, SEEK_SET) < 0)
+  {
+    throw std::runtime_error("Could not seek to offset " + std::to_string(offset) + " of the popVCF.");
+  }
+
+  /// Records of a block never refer to records of earlier blocks
+  FormatOptions const options = dd.options;
+  dd = DecodeData();
+  dd.options = options;
+  dd.write_genotypes = false;
+  is_pending = false;
+  is_done = false;
+}
+
+std::vector<std::string> RecordReader::get_sample_names() const
+{
+  std::vector<std::string> sample_names;
+  std::string_view const header_view(header.data(), header.size());
+  std::size_t const pos = header_view.rfind("#CHROM");
+
+  if (pos == std::string_view::npos)
+    return sample_names;
+
+  std::string_view line = header_view.substr(pos);
+  line = line.substr(0, line.find('\n'));
+  std::vector<std::string_view> const columns = split_string(line, '\t');
+
+  for (std::size_t c{9}; c < columns.size(); ++c)
+    sample_names.emplace_back(columns[c]);
+
+  return sample_names;
+}
+
+std::string_view RecordReader::get_site_column(long column_index) const
+{
+  std::size_t b{0};
+
+  for (; column_index > 0 && b < site.size(); ++b)
+  {
+    if (site[b] == '\t')
+      --column_index;
+  }
+
+  std::size_t e{b};
+
+  while (e < site.size() && site[e] != '\t' && site[e] != '\n')
+    ++e;
+
+  return std::string_view(site.data() + b, e - b);
+}
+
+} // namespace popvcf
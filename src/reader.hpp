@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "decode.hpp"
+#include "io.hpp"
+
+#include "htslib/kstring.h"
+
+namespace popvcf
+{
+//! Reads a popVCF one record at a time. Genotypes are not decoded to text, they are kept deduplicated in
+//! dd.unique_fields and dd.field2uid.
+class RecordReader
+{
+public:
+  DecodeData dd{};            //!< Decoding state, which holds the genotypes of the current record
+  std::vector<char> header{}; //!< Decoded header lines
+  std::vector<char> site{};   //!< Site columns of the current record (CHROM to FORMAT), each with its delimiter
+
+  //! Opens a popVCF, either bgzipped or not, and reads its header. Reading a \a region requires a tabix index.
+  explicit RecordReader(std::string const & popvcf_fn, std::string const & region = std::string());
+  ~RecordReader();
+
+  RecordReader(RecordReader const &) = delete;
+  RecordReader & operator=(RecordReader const &) = delete;
+
+  //! Reads the next record. Returns false when there are no more records (in the region).
+  bool next();
+
+  //! Loads the .gzi index of a bgzipped popVCF that is read as a whole, which seek() requires. Returns false if it
+  //! cannot be loaded.
+  bool load_gzi(std::string const & popvcf_fn);
+
+  //! Moves to the first record of a block, at \a offset in the uncompressed popVCF. Throws std::runtime_error if the
+  //! offset cannot be reached.
+  void seek(uint64_t const offset);
+
+  //! Returns the sample names of the "#CHROM" header line.
+  std::vector<std::string> get_sample_names() const;
+
+  //! Returns the site column with index \a column_index (0 is CHROM).
+  std::string_view get_site_column(long column_index) const;
+
+  //! Returns the genotype field of sample \a sample_index in the current record.
+  inline std::string const & get_genotype(std::size_t const sample_index) const
+  {
+    return dd.unique_fields[dd.field2uid[sample_index]];
+  }
+
+private:
+  bgzf_ptr in_bgzf;                           //!< Input stream when reading the whole file
+  hts_file_ptr in_hts;                        //!< Input stream when reading a region
+  tbx_t_ptr in_tbx;                           //!< Tabix index when reading a region
+  hts_itr_t_ptr in_itr;                       //!< Region iterator, nullptr if the region has no records
+  bool is_region{false};                      //!< True iff reading a region
+  long begin{-1};                             //!< Region begin, or -1 when the region is a whole contig
+  long end{std::numeric_limits<long>::max()}; //!< Region end
+  long safe_begin{0};                         //!< First position of the block containing the region begin
+  kstring_t str{0, 0, nullptr};               //!< Current line
+  std::vector<char> buffer_in{};              //!< Current line that is decoded
+  bool is_pending{false};                     //!< True iff str holds a record that has not been decoded yet
+  bool is_done{false};                        //!< True iff there are no more records to read
+
+  //! Reads the next line into str. Returns false at the end of the input.
+  bool read_line();
+};
+
+} // namespace popvcf
@@ -0,0 +1,271 @@
+#include "row_encoder.hpp"
+
+#include <algorithm> // std::max
+#include <cassert>
+#include <cstring> // std::memchr
+#include <future>
+#include <string>
+#include <utility>
+
+namespace popvcf
+{
+namespace
+{
+//! Runs \a func on each chunk in the thread pool and waits until all of them are done.
+template <typename Tfunc>
+void for_each_chunk(ThreadPool & pool, std::vector<RowChunk> & chunks, Tfunc const & func)
+{
+  std::vector<std::future<void>> results;
+  results.reserve(chunks.size());
+
+  for (RowChunk & chunk : chunks)
+    results.push_back(pool.submit([&func, &chunk]() { func(chunk); }));
+
+  for (std::future<void> & result : results)
+    result.get();
+}
+
+//! Finds the unique fields of a chunk of genotypes.
+void deduplicate_chunk(RowChunk & chunk, std::string_view const genotypes)
+{
+  chunk.fields.resize(0);
+  chunk.field2luid.resize(0);
+  chunk.local_unique_fields.resize(0);
+  chunk.local_first_fields.resize(0);
+  chunk.local_map.clear();
+
+  std::size_t b{chunk.begin};
+
+  while (b < chunk.end)
+  {
+    /// Fields end with '\t', except the last field of the row which ends with '\n'
+    char const * tab = static_cast<char const *>(std::memchr(genotypes.data() + b, '\t', chunk.end - b));
+    std::size_t const e = tab == nullptr ? chunk.end - 1 : tab - genotypes.data();
+    std::string_view const field = genotypes.substr(b, e - b);
+    auto insert_it = chunk.local_map.insert(std::make_pair(field, chunk.local_unique_fields.size()));
+
+    if (insert_it.second)
+    {
+      chunk.local_unique_fields.push_back(field);
+      chunk.local_first_fields.push_back(chunk.fields.size());
+    }
+
+    chunk.field2luid.push_back(insert_it.first->second);
+    chunk.fields.push_back(field);
+    b = e + 1;
+  }
+}
+
+//! Encodes the fields of a chunk against the previous row, in the same way as encode_buffer.
+void encode_chunk(RowChunk & chunk, std::size_t const n_fields, EncodeData & ed)
+{
+  chunk.out.resize(0);
+
+  for (std::size_t k{0}; k < chunk.fields.size(); ++k)
+  {
+    std::size_t const field_idx = chunk.first_field + k;
+    std::string_view const field = chunk.fields[k];
+    uint32_t const luid = chunk.field2luid[k];
+    uint32_t const uid = chunk.luid2uid[luid];
+    bool const is_unique = chunk.is_row_first[luid] && chunk.local_first_fields[luid] == k;
+    char const delimiter = field_idx + 1 == n_fields ? '\n' : '\t';
+    ed.field2uid[field_idx] = uid; // each chunk writes its own fields
+
+    if (field_idx < ed.prev_field2uid.size() && ed.prev_unique_fields[ed.prev_field2uid[field_idx]] == field)
+    {
+      /* Case 0 or 3: same as the field above. */
+      chunk.out.push_back(is_unique ? '$' : '&');
+
+      if (delimiter == '\n') /* never skip newline */
+        chunk.out.push_back('\n');
+    }
+    else if (!is_unique)
+    {
+      /* Case 4: Field is a duplicate in the current line. */
+      popvcf::to_chars(uid, chunk.out);
+      chunk.out.push_back(delimiter);
+    }
+    else
+    {
+      std::string const key(field);
+      auto prev_find_it = ed.prev_map_to_unique_fields.find(key);
+
+      if (prev_find_it != ed.prev_map_to_unique_fields.end())
+      {
+        /* Case 2: Field is unique in the current line but identical to a field in the previous line. */
+        chunk.out.push_back('%');
+        popvcf::to_chars(prev_find_it->second, chunk.out);
+      }
+      else if (auto seed_find_it = ed.seed_map.find(key); seed_find_it != ed.seed_map.end())
+      {
+        /* Case 5: Field is unique in the current line and not in the previous line, but it is a seed. */
+        chunk.out.push_back(SEED_MARKER);
+        popvcf::to_chars(seed_find_it->second, chunk.out);
+      }
+      else
+      {
+        /* Case 1: Field is unique in the current line and is not in the previous line. */
+        chunk.out.insert(chunk.out.end(), field.begin(), field.end());
+      }
+
+      chunk.out.push_back(delimiter);
+    }
+  }
+}
+
+} // namespace
+
+void RowEncoder::encode_genotypes(std::vector<char> & buffer_out, std::string_view const genotypes, EncodeData & ed)
+{
+  assert(genotypes.size() > 0 && genotypes.back() == '\n');
+  assert(ed.field2uid.empty());
+
+  /// Split the genotypes into chunks of about equal size that begin at a field
+  std::size_t const n_chunks = chunks.size();
+  std::size_t b{0};
+
+  for (std::size_t c{0}; c < n_chunks; ++c)
+  {
+    std::size_t e{genotypes.size()};
+
+    if (c + 1 < n_chunks)
+    {
+      std::size_t const tab = genotypes.find('\t', std::max(b, genotypes.size() * (c + 1) / n_chunks));
+      e = tab == std::string_view::npos ? genotypes.size() : tab + 1;
+    }
+
+    chunks[c].begin = b;
+    chunks[c].end = e;
+    b = e;
+  }
+
+  for_each_chunk(pool, chunks, [genotypes](RowChunk & chunk) { deduplicate_chunk(chunk, genotypes); });
+
+  /// Number the unique fields of the row in order of first appearance
+  std::size_t n_fields{0};
+
+  for (RowChunk & chunk : chunks)
+  {
+    chunk.first_field = n_fields;
+    n_fields += chunk.fields.size();
+    chunk.luid2uid.resize(chunk.local_unique_fields.size());
+    chunk.is_row_first.resize(chunk.local_unique_fields.size());
+
+    for (std::size_t l{0}; l < chunk.local_unique_fields.size(); ++l)
+    {
+      std::string_view const field = chunk.local_unique_fields[l];
+      auto insert_it = ed.map_to_unique_fields.insert(
+        std::pair<std::string, uint32_t>(std::piecewise_construct,
+                                         std::forward_as_tuple(field.data(), field.size()),
+                                         std::forward_as_tuple(ed.unique_fields.size())));
+
+      if (insert_it.second)
+        ed.unique_fields.emplace_back(field);
+
+      chunk.luid2uid[l] = insert_it.first->second;
+      chunk.is_row_first[l] = insert_it.second;
+    }
+  }
+
+  if (ed.options.has_record_prefix())
+  {
+    ed.in_frame = true;
+    ed.frame_begin = buffer_out.size();
+  }
+
+  if (ed.is_packed_row)
+  {
+    /// Packed genotypes are only a few bits per field, they are not worth encoding in parallel
+    for (RowChunk const & chunk : chunks)
+    {
+      for (std::size_t k{0}; k < chunk.fields.size(); ++k)
+      {
+        uint32_t const luid = chunk.field2luid[k];
+        ed.field2uid.push_back(chunk.luid2uid[luid]);
+        pack_field(ed, chunk.first_field + k, chunk.is_row_first[luid] && chunk.local_first_fields[luid] == k,
+                   chunk.fields[k]);
+      }
+    }
+
+    write_packed_row(buffer_out, ed);
+  }
+  else
+  {
+    ed.field2uid.resize(n_fields);
+    for_each_chunk(pool, chunks, [n_fields, &ed](RowChunk & chunk) { encode_chunk(chunk, n_fields, ed); });
+
+    write_history_marker(buffer_out, ed);
+
+    for (RowChunk const & chunk : chunks)
+      buffer_out.insert(buffer_out.end(), chunk.out.begin(), chunk.out.end());
+  }
+
+  if (ed.options.checksum)
+  {
+    update_checksum(ed, genotypes.data(), genotypes.size());
+    close_checksum(ed);
+  }
+
+  if (ed.in_frame)
+    close_frame(buffer_out, ed);
+
+  update_zone_map(ed);
+  ed.field = 0;
+}
+
+void RowEncoder::encode_lines(std::vector<char> & buffer_out, std::vector<char> & buffer_in, EncodeData & ed)
+{
+  std::size_t constexpr N_FIELDS_SITE_DATA{9}; // how many fields of the VCF contains site data
+  std::size_t b{0};                            // begin of the lines that have not been encoded
+  std::size_t line_begin{0};                   // begin of the current line
+  std::size_t scan_begin{n_scanned};           // where to look for the end of the current line
+
+  while (true)
+  {
+    char const * newline = static_cast<char const *>(
+      std::memchr(buffer_in.data() + scan_begin, '\n', buffer_in.size() - scan_begin));
+
+    if (newline == nullptr)
+      break;
+
+    std::size_t const line_end = newline - buffer_in.data() + 1;
+    std::string_view const line(buffer_in.data() + line_begin, line_end - line_begin);
+
+    if (line[0] != '#' && line.size() >= ROW_PARALLEL_MIN_SIZE)
+    {
+      /// Find the end of the site columns
+      std::size_t sites_end{0};
+
+      for (std::size_t f{0}; f < N_FIELDS_SITE_DATA && sites_end != std::string_view::npos; ++f)
+      {
+        sites_end = line.find('\t', sites_end);
+        sites_end = sites_end == std::string_view::npos ? sites_end : sites_end + 1;
+      }
+
+      if (sites_end != std::string_view::npos && line.size() - sites_end >= ROW_PARALLEL_MIN_SIZE)
+      {
+        /// Earlier lines and the site columns are encoded serially
+        lines.assign(buffer_in.begin() + b, buffer_in.begin() + line_begin + sites_end);
+        encode_buffer(buffer_out, lines, ed);
+        encode_genotypes(buffer_out, line.substr(sites_end), ed);
+        b = line_end;
+      }
+    }
+
+    line_begin = line_end;
+    scan_begin = line_end;
+  }
+
+  /// Encode the remaining complete lines
+  if (line_begin > b)
+  {
+    lines.assign(buffer_in.begin() + b, buffer_in.begin() + line_begin);
+    encode_buffer(buffer_out, lines, ed);
+  }
+
+  /// Keep the incomplete last line
+  buffer_in.erase(buffer_in.begin(), buffer_in.begin() + line_begin);
+  n_scanned = buffer_in.size();
+}
+
+} // namespace popvcf
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include <parallel_hashmap/phmap.h>
+
+#include "encode.hpp"
+#include "thread_pool.hpp"
+
+namespace popvcf
+{
+//! Rows with genotypes of at least this size are encoded in parallel
+std::size_t constexpr ROW_PARALLEL_MIN_SIZE{ENC_BUFFER_SIZE};
+
+//! Genotype fields of one row that are deduplicated and encoded by a single thread
+class RowChunk
+{
+public:
+  std::size_t begin{0};                                         //!< Begin of the chunk in the genotypes
+  std::size_t end{0};                                           //!< End of the chunk, after its last delimiter
+  std::size_t first_field{0};                                   //!< Index of the first field of the chunk in the row
+  std::vector<std::string_view> fields{};                       //!< Fields of the chunk, without delimiters
+  std::vector<uint32_t> field2luid{};                           //!< Index of each field in local_unique_fields
+  std::vector<std::string_view> local_unique_fields{};          //!< Unique fields in order of first appearance
+  std::vector<uint32_t> local_first_fields{};                   //!< Index of the first appearance of each unique field
+  phmap::flat_hash_map<std::string_view, uint32_t> local_map{}; //!< Index of each unique field
+  std::vector<uint32_t> luid2uid{};                             //!< Index of each unique field in the row
+  std::vector<bool> is_row_first{};                             //!< True iff the unique field is new in the row
+  std::vector<char> out{};                                      //!< Encoded fields
+};
+
+//! Encodes very wide rows using several threads. Each thread deduplicates a chunk of samples, the unique fields of the
+//! chunks are then numbered in order of first appearance, and finally each thread encodes its chunk against the
+//! previous row. The output is identical to the output of encode_buffer.
+class RowEncoder
+{
+public:
+  explicit RowEncoder(long const n_threads)
+    : pool(n_threads)
+    , chunks(n_threads)
+  {
+  }
+
+  //! Encodes the complete lines at the front of \a buffer_in. Genotypes of at least ROW_PARALLEL_MIN_SIZE bytes are
+  //! encoded in parallel, everything else by encode_buffer. The incomplete last line is kept in \a buffer_in.
+  void encode_lines(std::vector<char> & buffer_out, std::vector<char> & buffer_in, EncodeData & ed);
+
+  //! Encodes the \a genotypes of a row, which end with '\n'. The site columns of the row, including the tab after
+  //! FORMAT, must have been encoded by encode_buffer.
+  void encode_genotypes(std::vector<char> & buffer_out, std::string_view const genotypes, EncodeData & ed);
+
+private:
+  ThreadPool pool;
+  std::vector<RowChunk> chunks{};
+  std::vector<char> lines{};  //!< Lines that are encoded by encode_buffer
+  std::size_t n_scanned{0};   //!< Bytes at the front of the input buffer that have no newline
+};
+
+} // namespace popvcf
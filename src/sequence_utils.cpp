@@ -1,7 +1,9 @@
 #include "sequence_utils.hpp"
 
-#include <algorithm>   // std::find
+#include <algorithm>   // std::find, std::max
+#include <charconv>    // std::from_chars
 #include <cstdint>     // int32_t
+#include <stdexcept>   // std::runtime_error
 #include <string>      // std::string
 #include <string_view> // std::string_view
 #include <vector>      // std::vector
@@ -37,4 +39,55 @@ std::vector<std::string_view> split_string(Tstring const & str, char const delim
 template std::vector<std::string_view> split_string(std::string const & str, char const delimiter);
 template std::vector<std::string_view> split_string(std::string_view const & str, char const delimiter);
 
+void parse_region(std::string const & region, std::string & chrom, long & begin, long & end)
+{
+  if (auto colon = region.find(':'); colon == std::string::npos)
+  {
+    chrom = region;
+  }
+  else
+  {
+    chrom = region.substr(0, colon);
+
+    if (auto dash = region.find('-', colon + 1); dash == std::string::npos)
+    {
+      auto ret = std::from_chars(region.data() + colon + 1, region.data() + region.size(), begin);
+
+      if (ret.ec != std::errc())
+        throw std::runtime_error("Could not parse region: " + region);
+
+      end = begin;
+    }
+    else
+    {
+      auto ret_begin = std::from_chars(region.data() + colon + 1, region.data() + dash, begin);
+
+      if (ret_begin.ec != std::errc())
+        throw std::runtime_error("Could not parse region: " + region);
+
+      auto ret_end = std::from_chars(region.data() + dash + 1, region.data() + region.size(), end);
+
+      if (ret_end.ec != std::errc())
+        throw std::runtime_error("Could not parse region: " + region);
+    }
+  }
+}
+
+std::string get_block_region(std::string const & chrom, long const begin, long const end, long & safe_begin)
+{
+  std::string safe_region = chrom;
+  safe_begin = 0;
+
+  if (begin >= 0)
+  {
+    safe_begin = std::max(1l, (begin / BLOCK_SIZE) * BLOCK_SIZE);
+    safe_region.push_back(':');
+    safe_region.append(std::to_string(safe_begin));
+    safe_region.push_back('-');
+    safe_region.append(std::to_string(end));
+  }
+
+  return safe_region;
+}
+
 } // namespace popvcf
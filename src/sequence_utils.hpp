@@ -14,6 +14,17 @@ uint32_t constexpr CHAR_SET_SIZE = 69;
 uint32_t constexpr CHAR_SET_SIZE_2BYTES = CHAR_SET_SIZE * CHAR_SET_SIZE;
 char constexpr CHAR_SET_MIN = ':';
 
+long constexpr BLOCK_SIZE{10000}; //!< Records can only refer to earlier records within the same block of positions
+
+//! Returns true iff a record at \a pos1 of \a contig1 and a record at \a pos2 of \a contig2 are in the same block.
+inline bool is_same_block(std::string_view const contig1,
+                          long const pos1,
+                          std::string_view const contig2,
+                          long const pos2)
+{
+  return contig1 == contig2 && pos1 / BLOCK_SIZE == pos2 / BLOCK_SIZE;
+}
+
 long constexpr ENC_BUFFER_SIZE{4 * 65536}; //!< Buffer size of arrays when encoding
 long constexpr DEC_BUFFER_SIZE{8 * 65536}; //!< Buffer size of arrays when decoding
 
@@ -109,6 +120,13 @@ inline void to_chars(Tint char_val, Tbuffer_out & buffer_out)
 template <typename Tstring>
 std::vector<std::string_view> split_string(Tstring const & str, char const delimiter);
 
+//! Parses a region "chrN", "chrN:A" or "chrN:A-B". \a begin is left as -1 if the region has no positions.
+void parse_region(std::string const & region, std::string & chrom, long & begin, long & end);
+
+//! Returns the region to query from the tabix index, which starts at the block containing \a begin since records may
+//! refer to earlier records of their block. \a safe_begin is set to the first position of that block.
+std::string get_block_region(std::string const & chrom, long const begin, long const end, long & safe_begin);
+
 template <typename Tit>
 long get_vcf_pos(Tit begin, Tit end)
 {
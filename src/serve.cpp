@@ -0,0 +1,480 @@
+#include "serve.hpp"
+
+#include <algorithm>  // std::max
+#include <array>      // std::array
+#include <cerrno>     // errno
+#include <csignal>    // std::signal
+#include <cstdlib>    // std::exit
+#include <cstring>    // std::strerror
+#include <functional> // std::ref
+#include <iostream>   // std::cerr
+#include <limits>     // std::numeric_limits
+#include <memory>     // std::shared_ptr
+#include <stdexcept>  // std::runtime_error
+#include <string>     // std::string
+#include <thread>     // std::thread
+#include <vector>     // std::vector
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <parallel_hashmap/phmap.h>
+
+#include "decode.hpp"
+#include "io.hpp"
+#include "sequence_utils.hpp" // parse_region, get_vcf_pos, split_string
+
+#include "htslib/hts.h"
+#include "htslib/kstring.h"
+#include "htslib/tbx.h"
+
+namespace popvcf
+{
+std::shared_ptr<DecodedBlock const> BlockCache::get(std::string const & key)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto find_it = entries.find(key);
+
+  if (find_it == entries.end())
+    return nullptr;
+
+  lru.splice(lru.begin(), lru, find_it->second); // mark as most recently used
+  return find_it->second->second;
+}
+
+void BlockCache::insert(std::string const & key, std::shared_ptr<DecodedBlock const> block)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto find_it = entries.find(key);
+
+  if (find_it != entries.end())
+  {
+    /// Another query decoded the same block
+    bytes -= find_it->second->second->bytes();
+    lru.erase(find_it->second);
+    entries.erase(find_it);
+  }
+
+  bytes += block->bytes();
+  lru.emplace_front(key, std::move(block));
+  entries[key] = lru.begin();
+
+  /// Evict the least recently used blocks, but always keep the newest one
+  while (bytes > max_bytes && lru.size() > 1)
+  {
+    bytes -= lru.back().second->bytes();
+    entries.erase(lru.back().first);
+    lru.pop_back();
+  }
+}
+
+namespace
+{
+std::size_t constexpr FLUSH_SIZE{DEC_BUFFER_SIZE}; //!< Responses are sent in parts of about this size
+std::string socket_path_to_remove{};               //!< Socket that is removed when the server is stopped
+
+void stop_server(int /*signal*/)
+{
+  unlink(socket_path_to_remove.c_str());
+  _exit(0);
+}
+
+//! Writes all of \a data to socket \a fd. Returns false if the client has disconnected.
+bool send_all(int const fd, char const * data, std::size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t const written = write(fd, data, size);
+
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      return false;
+    }
+
+    data += written;
+    size -= written;
+  }
+
+  return true;
+}
+
+//! Appends the site columns and the genotypes of the samples with the given \a columns of a decoded \a line, which
+//! ends with '\n'. All columns are appended if \a columns is empty.
+void append_columns(std::string & out,
+                    std::string_view const line,
+                    std::vector<long> const & columns,
+                    std::vector<std::size_t> & column_ends)
+{
+  if (columns.empty())
+  {
+    out.append(line);
+    return;
+  }
+
+  column_ends.resize(0);
+
+  for (std::size_t i{0}; i < line.size(); ++i)
+  {
+    if (line[i] == '\t' || line[i] == '\n')
+      column_ends.push_back(i);
+  }
+
+  std::size_t constexpr N_SITE_COLUMNS{9};
+  std::size_t const site_end = std::min(N_SITE_COLUMNS, column_ends.size()) - 1;
+  out.append(line.substr(0, column_ends[site_end]));
+
+  for (long const c : columns)
+  {
+    if (c >= static_cast<long>(column_ends.size()))
+      continue; // a record without genotypes
+
+    std::size_t const b = column_ends[c - 1] + 1;
+    out.push_back('\t');
+    out.append(line.substr(b, column_ends[c] - b));
+  }
+
+  out.push_back('\n');
+}
+
+//! The file, index and decoded blocks shared by all connections
+class Server
+{
+public:
+  std::string popvcf_fn{};                                 //!< Path of the popVCF
+  tbx_t_ptr tbx;                                           //!< Tabix index, which is only read after it is loaded
+  FormatOptions options{};                                 //!< Encoding options of the popVCF
+  std::string header{};                                    //!< Decoded header lines
+  phmap::flat_hash_map<std::string, long> sample2column{}; //!< Column index of each sample
+  BlockCache cache;                                        //!< Decoded blocks
+
+  Server(std::string const & fn, std::size_t const cache_bytes)
+    : popvcf_fn(fn)
+    , tbx(popvcf::open_tbx_t(fn.c_str()))
+    , cache(cache_bytes)
+  {
+    hts_file_ptr hts = popvcf::open_hts_file(popvcf_fn.c_str(), "r");
+    kstring_t str{0, 0, nullptr};
+    std::vector<char> buffer_in;
+    DecodeData dd;
+
+    while (hts_getline(hts.get(), KS_SEP_LINE, &str) >= 0)
+    {
+      if (str.l == 0 || str.s[0] != tbx->conf.meta_char)
+        break;
+
+      buffer_in.assign(str.s, str.s + str.l);
+      buffer_in.push_back('\n');
+      decode_buffer</*is_region=*/false>(header, buffer_in, dd);
+    }
+
+    free(str.s);
+    options = dd.options;
+
+    /// The last header line has the sample names
+    std::size_t const last_line = header.rfind('\n', header.size() < 2 ? 0 : header.size() - 2);
+    std::string_view const chrom_line(header.data() + (last_line == std::string::npos ? 0 : last_line + 1));
+    std::vector<std::string_view> const columns = split_string(chrom_line.substr(0, chrom_line.size() - 1), '\t');
+
+    for (std::size_t c{9}; c < columns.size(); ++c)
+      sample2column[std::string(columns[c])] = c;
+  }
+
+  //! Answers a \a query and sends the response to \a fd. Returns false if the client has disconnected.
+  bool answer(htsFile * hts, std::string_view const query, int const fd)
+  {
+    std::string response;
+    std::vector<std::size_t> column_ends;
+    bool is_connected{true};
+
+    try
+    {
+      std::size_t const tab = query.find('\t');
+      std::string const region(query.substr(0, tab));
+      std::vector<long> const columns = get_columns(tab == std::string_view::npos ? "" : query.substr(tab + 1));
+
+      if (region == "#")
+      {
+        std::size_t const last_line = header.rfind('\n', header.size() < 2 ? 0 : header.size() - 2);
+        std::size_t const b = last_line == std::string::npos ? 0 : last_line + 1;
+        response.append(header, 0, b);
+        append_columns(response, std::string_view(header).substr(b), columns, column_ends);
+      }
+      else
+      {
+        std::string chrom;
+        long begin{-1};
+        long end{std::numeric_limits<long>::max()};
+        parse_region(region, chrom, begin, end);
+
+        auto write_rows = [&](DecodedBlock const & block)
+        {
+          std::size_t row_begin{0};
+
+          for (std::size_t r{0}; r < block.positions.size() && is_connected; ++r)
+          {
+            if (begin < 0 || (block.positions[r] >= begin && block.positions[r] <= end))
+            {
+              std::string_view const row(block.data.data() + row_begin, block.row_ends[r] - row_begin);
+              append_columns(response, row, columns, column_ends);
+
+              if (response.size() >= FLUSH_SIZE)
+              {
+                is_connected = send_all(fd, response.data(), response.size());
+                response.resize(0);
+              }
+            }
+
+            row_begin = block.row_ends[r];
+          }
+        };
+
+        if (begin < 0)
+        {
+          read_blocks(hts, chrom, -1, -1, write_rows); // whole contig
+        }
+        else
+        {
+          long const last_block = end / BLOCK_SIZE;
+
+          for (long b{begin / BLOCK_SIZE}; b <= last_block && is_connected; ++b)
+          {
+            if (auto block = cache.get(get_key(chrom, b)); block != nullptr)
+            {
+              write_rows(*block);
+              continue;
+            }
+
+            /// Read consecutive blocks that are not cached with a single query
+            long run_end{b};
+
+            while (run_end < last_block && cache.get(get_key(chrom, run_end + 1)) == nullptr)
+              ++run_end;
+
+            read_blocks(hts, chrom, b, run_end, write_rows);
+            b = run_end;
+          }
+        }
+      }
+    }
+    catch (std::exception const & e)
+    {
+      response.append("##ERROR=");
+      response.append(e.what());
+      response.push_back('\n');
+    }
+
+    response.push_back('\n'); // an empty line ends the response
+    return is_connected && send_all(fd, response.data(), response.size());
+  }
+
+private:
+  inline static std::string get_key(std::string const & chrom, long const block)
+  {
+    return chrom + ':' + std::to_string(block);
+  }
+
+  //! Returns the columns of a comma separated list of samples.
+  std::vector<long> get_columns(std::string_view const samples) const
+  {
+    std::vector<long> columns;
+
+    if (samples.empty())
+      return columns;
+
+    for (std::string_view const sample : split_string(samples, ','))
+    {
+      auto find_it = sample2column.find(std::string(sample));
+
+      if (find_it == sample2column.end())
+        throw std::runtime_error("Unknown sample " + std::string(sample));
+
+      columns.push_back(find_it->second);
+    }
+
+    return columns;
+  }
+
+  //! Decodes the blocks from \a first_block to \a last_block of \a chrom, or all of its blocks if \a first_block is
+  //! negative. Each decoded block is cached and passed to \a on_block in order.
+  template <typename Tcallback>
+  void read_blocks(htsFile * hts,
+                   std::string const & chrom,
+                   long const first_block,
+                   long const last_block,
+                   Tcallback && on_block)
+  {
+    std::string region = chrom;
+
+    if (first_block >= 0)
+    {
+      region.push_back(':');
+      region.append(std::to_string(std::max(1l, first_block * BLOCK_SIZE)));
+      region.push_back('-');
+      region.append(std::to_string(last_block * BLOCK_SIZE + BLOCK_SIZE - 1));
+    }
+
+    hts_itr_t_ptr itr(tbx_itr_querys(tbx.get(), region.c_str()), popvcf::close_hts_itr_t);
+    kstring_t str{0, 0, nullptr};
+    std::vector<char> buffer_in;
+    auto block = std::make_shared<DecodedBlock>();
+    long block_id{first_block}; // block that is being decoded
+    DecodeData dd;
+    dd.options = options;
+
+    auto finish_block = [&]()
+    {
+      cache.insert(get_key(chrom, block_id), block);
+      on_block(*block);
+      block = std::make_shared<DecodedBlock>();
+      dd = DecodeData();
+      dd.options = options;
+    };
+
+    while (itr != nullptr && tbx_itr_next(hts, tbx.get(), itr.get(), &str) > 0)
+    {
+      long const pos = get_vcf_pos(str.s, str.s + str.l);
+      long const b = pos / BLOCK_SIZE;
+
+      if (b < first_block)
+        continue; // overlaps the region but starts in an earlier block
+
+      if (block_id < 0)
+        block_id = b;
+
+      /// Blocks without records are cached as well, unless the whole contig is read
+      while (block_id < b)
+      {
+        finish_block();
+        block_id = first_block >= 0 ? block_id + 1 : b;
+      }
+
+      buffer_in.assign(str.s, str.s + str.l);
+      buffer_in.push_back('\n');
+      decode_buffer</*is_region=*/false>(block->data, buffer_in, dd);
+      block->positions.push_back(pos);
+      block->row_ends.push_back(block->data.size());
+    }
+
+    free(str.s);
+
+    if (block_id >= 0)
+      finish_block();
+
+    while (first_block >= 0 && block_id < last_block)
+    {
+      ++block_id;
+      finish_block();
+    }
+  }
+};
+
+void serve_connection(Server & server, int const fd)
+{
+  hts_file_ptr hts = popvcf::open_hts_file(server.popvcf_fn.c_str(), "r"); // each connection reads its own stream
+  std::array<char, 4096> buffer;
+  std::string pending;
+  bool is_connected{true};
+
+  while (is_connected)
+  {
+    ssize_t const read_bytes = read(fd, buffer.data(), buffer.size());
+
+    if (read_bytes < 0 && errno == EINTR)
+      continue;
+
+    if (read_bytes <= 0)
+      break;
+
+    pending.append(buffer.data(), read_bytes);
+    std::size_t b{0};
+
+    for (std::size_t e = pending.find('\n'); e != std::string::npos && is_connected; e = pending.find('\n', b))
+    {
+      std::string_view query(pending.data() + b, e - b);
+
+      if (!query.empty() && query.back() == '\r')
+        query.remove_suffix(1);
+
+      if (!query.empty())
+        is_connected = server.answer(hts.get(), query, fd);
+
+      b = e + 1;
+    }
+
+    pending.erase(0, b);
+  }
+
+  close(fd);
+}
+
+} // namespace
+
+void serve_file(std::string const & popvcf_fn, std::string const & socket_path, long const cache_size)
+{
+  Server server(popvcf_fn, std::max(0l, cache_size) * 1024 * 1024);
+
+  /// Create the socket
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+
+  if (socket_path.size() >= sizeof(address.sun_path))
+  {
+    std::cerr << "[popvcf] ERROR: Socket path is too long: " << socket_path << std::endl;
+    std::exit(1);
+  }
+
+  socket_path.copy(address.sun_path, socket_path.size());
+
+  /// Replace a socket left by a server that was not stopped cleanly, but no other kinds of files
+  struct stat st;
+
+  if (lstat(socket_path.c_str(), &st) == 0)
+  {
+    if (!S_ISSOCK(st.st_mode))
+    {
+      std::cerr << "[popvcf] ERROR: " << socket_path << " exists and is not a socket." << std::endl;
+      std::exit(1);
+    }
+
+    unlink(socket_path.c_str());
+  }
+
+  int const server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (server_fd < 0 || bind(server_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      listen(server_fd, SOMAXCONN) != 0)
+  {
+    std::cerr << "[popvcf] ERROR: Could not listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+    std::exit(1);
+  }
+
+  socket_path_to_remove = socket_path;
+  std::signal(SIGPIPE, SIG_IGN); // a client that disconnects is noticed when sending to it
+  std::signal(SIGINT, stop_server);
+  std::signal(SIGTERM, stop_server);
+  std::cerr << "[popvcf] Serving " << popvcf_fn << " on " << socket_path << std::endl;
+
+  /// Each connection is served by its own thread
+  while (true)
+  {
+    int const fd = accept(server_fd, nullptr, nullptr);
+
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+
+      std::cerr << "[popvcf] ERROR: Could not accept a connection: " << std::strerror(errno) << std::endl;
+      std::exit(1);
+    }
+
+    std::thread(serve_connection, std::ref(server), fd).detach();
+  }
+}
+
+} // namespace popvcf
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <parallel_hashmap/phmap.h>
+
+namespace popvcf
+{
+//! Decoded records of one block of positions
+class DecodedBlock
+{
+public:
+  std::string data{};                  //!< Decoded records, each ending with '\n'
+  std::vector<long> positions{};       //!< Position of each record
+  std::vector<std::size_t> row_ends{}; //!< End of each record in data
+
+  inline std::size_t bytes() const
+  {
+    return data.size() + positions.size() * (sizeof(long) + sizeof(std::size_t)) + sizeof(DecodedBlock);
+  }
+};
+
+//! A thread-safe cache of decoded blocks. The least recently used blocks are evicted when the cache is full.
+class BlockCache
+{
+public:
+  explicit BlockCache(std::size_t const max_bytes)
+    : max_bytes(max_bytes)
+  {
+  }
+
+  //! Returns the block with \a key, or nullptr if it is not cached.
+  std::shared_ptr<DecodedBlock const> get(std::string const & key);
+
+  //! Adds a block to the cache. Blocks that are in use are kept alive by their shared pointers after eviction.
+  void insert(std::string const & key, std::shared_ptr<DecodedBlock const> block);
+
+private:
+  using Tentry = std::pair<std::string, std::shared_ptr<DecodedBlock const>>;
+
+  std::size_t max_bytes{0};                                                 //!< Maximum size of the cached blocks
+  std::size_t bytes{0};                                                     //!< Size of the cached blocks
+  std::list<Tentry> lru{};                                                  //!< Blocks, most recently used first
+  phmap::flat_hash_map<std::string, std::list<Tentry>::iterator> entries{}; //!< Cached blocks by key
+  std::mutex mutex{};
+};
+
+//! Answers queries on a bgzipped and tabix indexed popVCF over a Unix socket until the process is stopped. The index,
+//! the decoded header and up to \a cache_size megabytes of decoded blocks are kept in memory between queries.
+//!
+//! A query is a line with a region, optionally followed by a tab and a comma separated list of samples. The region "#"
+//! queries the header. The response has the decoded lines and ends with an empty line.
+void serve_file(std::string const & popvcf_fn, std::string const & socket_path, long const cache_size);
+
+} // namespace popvcf
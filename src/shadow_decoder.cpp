@@ -0,0 +1,105 @@
+#include "shadow_decoder.hpp"
+
+#include <algorithm> // std::min, std::mismatch
+#include <cstdint>   // uint64_t
+#include <cstdlib>   // std::exit
+#include <cstring>   // std::memcmp
+#include <iostream>  // std::cerr
+#include <vector>    // std::vector
+
+#include "decode.hpp"
+
+namespace popvcf
+{
+namespace
+{
+std::size_t constexpr N_SHADOW_JOBS{4}; //!< Jobs that the encoder can be ahead of the shadow decoder
+
+} // namespace
+
+ShadowDecoder::ShadowDecoder(FormatOptions const & options)
+  : jobs(N_SHADOW_JOBS)
+{
+  thread = std::thread(&ShadowDecoder::run, this, options);
+}
+
+ShadowDecoder::~ShadowDecoder()
+{
+  if (thread.joinable())
+    finish();
+}
+
+void ShadowDecoder::add(char const * input,
+                        std::size_t const input_size,
+                        char const * output,
+                        std::size_t const output_size)
+{
+  Job job;
+  job.input.assign(input, input + input_size);
+  job.output.assign(output, output + output_size);
+  jobs.push(job);
+}
+
+void ShadowDecoder::finish()
+{
+  Job job;
+  job.is_last = true;
+  jobs.push(job);
+  thread.join();
+}
+
+void ShadowDecoder::run(FormatOptions const & options)
+{
+  std::vector<char> buffer_in; // output of the encoder that has not been decoded yet
+  std::vector<char> decoded;   // decoded output that has not been compared yet
+  std::vector<char> expected;  // input of the encoder that has not been compared yet
+  DecodeData dd;
+  dd.options = options;
+  uint64_t n_compared{0}; // bytes of input that have been compared
+
+  auto compare = [&]()
+  {
+    std::size_t const n = std::min(decoded.size(), expected.size());
+
+    if (std::memcmp(decoded.data(), expected.data(), n) != 0)
+    {
+      std::size_t const m =
+        std::mismatch(decoded.begin(), decoded.begin() + n, expected.begin()).first - decoded.begin();
+      std::cerr << "[popvcf] ERROR: The encoded output does not decode to the input at byte " << n_compared + m
+                << " of the input." << std::endl;
+      std::exit(1);
+    }
+
+    n_compared += n;
+    decoded.erase(decoded.begin(), decoded.begin() + n);
+    expected.erase(expected.begin(), expected.begin() + n);
+  };
+
+  while (true)
+  {
+    Job job = jobs.pop();
+
+    if (job.is_last)
+      break;
+
+    expected.insert(expected.end(), job.input.begin(), job.input.end());
+    buffer_in.insert(buffer_in.end(), job.output.begin(), job.output.end());
+    decode_buffer</*is_region=*/false>(decoded, buffer_in, dd);
+    compare();
+  }
+
+  /// Like the encoder, the decoder copies the end of an input without a newline
+  if (dd.in_size != 0)
+    decoded.insert(decoded.end(), buffer_in.begin(), buffer_in.end());
+
+  compare();
+
+  if (!decoded.empty() || !expected.empty())
+  {
+    std::cerr << "[popvcf] ERROR: The encoded output decodes to " << (decoded.empty() ? "less" : "more")
+              << " than the input after byte " << n_compared << " of the input." << std::endl;
+    std::exit(1);
+  }
+}
+
+} // namespace popvcf
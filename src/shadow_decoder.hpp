@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "format.hpp"
+#include "spsc_queue.hpp"
+
+namespace popvcf
+{
+//! Decodes the output of an encoder on its own thread while the encoder runs, and compares the decoded output with
+//! the input of the encoder. Exits with an error at the first byte that differs.
+class ShadowDecoder
+{
+public:
+  //! Starts the decoding thread. \a options are the options of the output, which has no options header line if the
+  //! encoding is resumed.
+  explicit ShadowDecoder(FormatOptions const & options);
+  ~ShadowDecoder();
+
+  ShadowDecoder(ShadowDecoder const &) = delete;
+  ShadowDecoder & operator=(ShadowDecoder const &) = delete;
+
+  //! Adds input that has been encoded and the output it was encoded to. The output may end in the middle of a record
+  //! and the encoded records of the input may continue in later output.
+  void add(char const * input, std::size_t const input_size, char const * output, std::size_t const output_size);
+
+  //! Waits until all output that has been added is decoded and compared. Exits if it does not decode to all of the
+  //! input.
+  void finish();
+
+private:
+  //! Input and output of one call of the encoder
+  class Job
+  {
+  public:
+    std::vector<char> input{};
+    std::vector<char> output{};
+    bool is_last{false};
+  };
+
+  SpscQueue<Job> jobs;
+  std::thread thread;
+
+  //! Decodes and compares the output of the jobs until the last job.
+  void run(FormatOptions const & options);
+};
+
+} // namespace popvcf
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace popvcf
+{
+std::size_t constexpr SITE_INFO_COLUMN{7}; //!< Index of the INFO column
+
+//! Returns true iff site column \a field is encoded with the site_columns option, which are ID, QUAL, FILTER, INFO
+//! and FORMAT. CHROM, POS, REF and ALT are kept as they are since tabix and the decoder read them.
+inline bool is_coded_site_column(std::size_t const field)
+{
+  return field == 2 || (field >= 5 && field <= 8);
+}
+
+//! Site columns of the previous record, which the site columns of a record are encoded against with the site_columns
+//! option. A column that is the same as above is written empty. In INFO, an entry that is the same as the entry at the
+//! same index above is written empty, and an entry with the same key is written as "=<value>". Neither empty columns
+//! nor INFO entries without a key are valid VCF, so literal columns always decode as themselves.
+class SiteColumns
+{
+public:
+  //! Forgets the previous record, e.g. at the start of a block.
+  inline void clear()
+  {
+    for (std::string & column : prev)
+      column.resize(0);
+  }
+
+  //! Writes \a column of site column \a field to \a buffer_out, encoded against the previous record.
+  template <typename Tbuffer_out>
+  inline void encode(Tbuffer_out & buffer_out, std::size_t const field, std::string_view const column)
+  {
+    if (column == prev[field])
+      return;
+
+    if (column.empty())
+      site_column_error("An empty site column");
+
+    if (field != SITE_INFO_COLUMN)
+    {
+      buffer_out.insert(buffer_out.end(), column.begin(), column.end());
+      prev[field].assign(column);
+      return;
+    }
+
+    split_entries(column, entries);
+    split_entries(prev[field], prev_entries);
+    std::size_t const begin = buffer_out.size();
+
+    for (std::size_t k{0}; k < entries.size(); ++k)
+    {
+      std::string_view const entry = entries[k];
+
+      if (entry.empty() || entry[0] == '=')
+        site_column_error("An INFO entry without a key");
+
+      if (k > 0)
+        buffer_out.push_back(';');
+
+      if (k < prev_entries.size() && !prev[field].empty())
+      {
+        if (entry == prev_entries[k])
+          continue; // same as the entry above
+
+        std::size_t const key_size = get_key_size(entry);
+
+        if (key_size < entry.size() && entry.substr(0, key_size) == prev_entries[k].substr(0, key_size) &&
+            get_key_size(prev_entries[k]) == key_size)
+        {
+          /// Same key as the entry above, only the value is written
+          buffer_out.insert(buffer_out.end(), entry.begin() + key_size, entry.end());
+          continue;
+        }
+      }
+
+      buffer_out.insert(buffer_out.end(), entry.begin(), entry.end());
+    }
+
+    /// An empty column means that the whole column is the same as above
+    if (buffer_out.size() == begin)
+      buffer_out.insert(buffer_out.end(), column.begin(), column.end());
+
+    prev[field].assign(column);
+  }
+
+  //! Decodes \a column of site column \a field and returns the decoded column, which stays valid until the column of
+  //! the next record is decoded.
+  inline std::string const & decode(std::size_t const field, std::string_view const column)
+  {
+    if (column.empty())
+      return prev[field];
+
+    if (field != SITE_INFO_COLUMN || prev[field].empty())
+    {
+      prev[field].assign(column);
+      return prev[field];
+    }
+
+    split_entries(column, entries);
+    split_entries(prev[field], prev_entries);
+    decoded.resize(0);
+
+    for (std::size_t k{0}; k < entries.size(); ++k)
+    {
+      std::string_view const entry = entries[k];
+
+      if (k > 0)
+        decoded.push_back(';');
+
+      if (k < prev_entries.size() && entry.empty())
+        decoded.append(prev_entries[k]);
+      else if (k < prev_entries.size() && entry[0] == '=')
+        decoded.append(prev_entries[k].substr(0, get_key_size(prev_entries[k]))).append(entry);
+      else
+        decoded.append(entry);
+    }
+
+    prev[field].swap(decoded);
+    return prev[field];
+  }
+
+private:
+  std::array<std::string, 9> prev{};            //!< Site columns of the previous record
+  std::vector<std::string_view> entries{};      //!< INFO entries of the current record
+  std::vector<std::string_view> prev_entries{}; //!< INFO entries of the previous record
+  std::string decoded{};                        //!< INFO of the current record while it is decoded
+
+  //! Splits INFO into its entries, keeping empty entries.
+  static inline void split_entries(std::string_view const info, std::vector<std::string_view> & info_entries)
+  {
+    info_entries.resize(0);
+    std::size_t b{0};
+
+    for (std::size_t e = info.find(';'); e != std::string_view::npos; b = e + 1, e = info.find(';', b))
+      info_entries.push_back(info.substr(b, e - b));
+
+    info_entries.push_back(info.substr(b));
+  }
+
+  //! Returns the size of the key of an INFO entry, which is the size of the entry if it has no value.
+  static inline std::size_t get_key_size(std::string_view const entry)
+  {
+    return std::min(entry.find('='), entry.size());
+  }
+
+  [[noreturn]] static void site_column_error(char const * what)
+  {
+    std::cerr << "[popvcf] ERROR: " << what << " cannot be encoded with the site_columns option, which requires valid "
+              << "VCF site columns." << std::endl;
+    std::exit(1);
+  }
+};
+
+} // namespace popvcf
@@ -0,0 +1,197 @@
+#include "split.hpp"
+
+#include <algorithm>   // std::count, std::lower_bound, std::max, std::min
+#include <charconv>    // std::from_chars
+#include <cstdint>     // uint64_t
+#include <cstdio>      // fwrite
+#include <cstdlib>     // std::exit, free
+#include <iostream>    // std::cerr
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+#include "concat.hpp" // read_bgzf_header, copy_bgzf_blocks, copy_bgzf_range
+#include "io.hpp"
+#include "sequence_utils.hpp" // is_same_block
+
+#include "htslib/bgzf.h"
+#include "htslib/kstring.h"
+#include "htslib/tbx.h"
+
+namespace popvcf
+{
+namespace
+{
+//! A block of a popVCF, which records cannot refer outside of
+class SplitBlock
+{
+public:
+  uint64_t voffset{0};        //!< Virtual offset of the first record of the block
+  uint64_t cost{0};           //!< Estimated decoding work of the block
+  std::string first_record{}; //!< CHROM and POS of the first record
+  std::string last_record{};  //!< CHROM and POS of the last record
+  uint64_t n_records{0};
+};
+
+//! Returns the name of shard \a s of \a n_shards, numbered from 1 with as many digits as the last shard.
+std::string get_shard_fn(std::string const & prefix, long const s, long const n_shards)
+{
+  std::string number = std::to_string(s + 1);
+  number.insert(0, std::to_string(n_shards).size() - number.size(), '0');
+  return prefix + "." + number + ".popvcf.gz";
+}
+
+} // namespace
+
+void split_file(std::string const & popvcf_fn, std::string const & prefix, long n_shards, uint64_t const target_size)
+{
+  popvcf::bgzf_ptr in_bgzf = popvcf::open_bgzf(popvcf_fn, "r");
+
+  if (bgzf_compression(in_bgzf.get()) != bgzf)
+  {
+    std::cerr << "[popvcf] ERROR: " << popvcf_fn << " is not bgzipped. Encode it with '-Oz' before splitting."
+              << std::endl;
+    std::exit(1);
+  }
+
+  std::string header;
+  read_bgzf_header(in_bgzf.get(), header);
+
+  /// Each sample costs about the same to decode besides the size of the encoded record
+  std::size_t const column_header_begin = header.rfind("#CHROM");
+  long const n_tabs = column_header_begin == std::string::npos
+                        ? 0
+                        : std::count(header.begin() + column_header_begin, header.end(), '\t');
+  uint64_t const n_samples = std::max(0L, n_tabs - 8);
+
+  /// Find the blocks and their costs, the records are only read up to POS
+  std::vector<SplitBlock> blocks;
+  kstring_t str{0, 0, nullptr};
+  std::string contig;
+  long pos{0};
+  uint64_t voffset = bgzf_tell(in_bgzf.get());
+
+  while (bgzf_getline(in_bgzf.get(), '\n', &str) >= 0)
+  {
+    std::string_view const line(str.s, str.l);
+    std::size_t const tab1 = line.find('\t');
+    std::size_t const tab2 = line.find('\t', tab1 + 1);
+
+    if (tab1 == std::string_view::npos || tab2 == std::string_view::npos)
+    {
+      std::cerr << "[popvcf] ERROR: Invalid record in " << popvcf_fn << ": " << line.substr(0, 100) << std::endl;
+      std::exit(1);
+    }
+
+    std::string_view const next_contig = line.substr(0, tab1);
+    long next_pos{0};
+    std::from_chars(line.data() + tab1 + 1, line.data() + tab2, next_pos);
+
+    if (blocks.empty() || !is_same_block(next_contig, next_pos, contig, pos))
+    {
+      blocks.emplace_back();
+      blocks.back().voffset = voffset;
+      blocks.back().first_record.assign(line.substr(0, tab2));
+      contig.assign(next_contig);
+    }
+
+    SplitBlock & block = blocks.back();
+    block.cost += line.size() + 1 + n_samples;
+    block.last_record.assign(line.substr(0, tab2));
+    ++block.n_records;
+    pos = next_pos;
+    voffset = bgzf_tell(in_bgzf.get());
+  }
+
+  free(str.s);
+  uint64_t const end_voffset = voffset;
+
+  if (n_shards <= 0)
+    n_shards = std::max<uint64_t>(1, ((end_voffset >> 16) + target_size - 1) / target_size);
+
+  if (static_cast<std::size_t>(n_shards) > blocks.size())
+  {
+    std::cerr << "[popvcf] WARNING: " << popvcf_fn << " has only " << blocks.size() << " blocks, which is the most "
+              << "shards it can be split into.\n";
+    n_shards = std::max<long>(1, blocks.size());
+  }
+
+  /// Cut where the cumulative cost is closest to an even share, each shard gets at least one block
+  std::vector<uint64_t> cost_before(blocks.size() + 1, 0); // cost of the blocks before each block
+
+  for (std::size_t b{0}; b < blocks.size(); ++b)
+    cost_before[b + 1] = cost_before[b] + blocks[b].cost;
+
+  std::vector<std::size_t> cuts{0}; // first block of each shard
+
+  for (long s{1}; s < n_shards; ++s)
+  {
+    uint64_t const target = cost_before.back() * s / n_shards;
+    std::size_t b = std::lower_bound(cost_before.begin(), cost_before.end(), target) - cost_before.begin();
+
+    if (b > 0 && target - cost_before[b - 1] < cost_before[b] - target)
+      --b;
+
+    b = std::max(b, cuts.back() + 1);
+    b = std::min(b, blocks.size() - (n_shards - s));
+    cuts.push_back(b);
+  }
+
+  cuts.push_back(blocks.size());
+
+  /// Write the shards, each with the header and a tabix index
+  std::string line = "#SHARD\tFIRST_CHROM\tFIRST_POS\tLAST_CHROM\tLAST_POS\tN_RECORDS\n";
+
+  for (long s{0}; s < n_shards; ++s)
+  {
+    std::string const shard_fn = get_shard_fn(prefix, s, n_shards);
+    std::size_t const first_block = cuts[s];
+    std::size_t const end_block = cuts[s + 1];
+
+    {
+      popvcf::bgzf_ptr out_bgzf = popvcf::open_bgzf(shard_fn, "w");
+      popvcf::write_bgzf(out_bgzf.get(), header.data(), header.size());
+
+      if (first_block < end_block)
+      {
+        uint64_t const begin = blocks[first_block].voffset;
+
+        if (end_block == blocks.size())
+        {
+          copy_bgzf_range(in_bgzf.get(), out_bgzf.get(), begin, begin);
+          copy_bgzf_blocks(in_bgzf.get(), out_bgzf.get());
+        }
+        else
+        {
+          copy_bgzf_range(in_bgzf.get(), out_bgzf.get(), begin, blocks[end_block].voffset);
+        }
+      }
+    } // closes the shard
+
+    if (tbx_index_build(shard_fn.c_str(), 0, &tbx_conf_vcf) != 0)
+    {
+      std::cerr << "[popvcf] ERROR: Failed building a tabix index for " << shard_fn << std::endl;
+      std::exit(1);
+    }
+
+    uint64_t n_records{0};
+
+    for (std::size_t b{first_block}; b < end_block; ++b)
+      n_records += blocks[b].n_records;
+
+    line.append(shard_fn).push_back('\t');
+
+    if (first_block < end_block)
+      line.append(blocks[first_block].first_record).append("\t").append(blocks[end_block - 1].last_record);
+    else
+      line.append(".\t.\t.\t.");
+
+    line.append("\t").append(std::to_string(n_records)).push_back('\n');
+  }
+
+  fwrite(line.data(), 1, line.size(), stdout);
+  std::cerr << "[popvcf] Split " << popvcf_fn << " into " << n_shards << " shards of " << blocks.size()
+            << " blocks." << std::endl;
+}
+
+} // namespace popvcf
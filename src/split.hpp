@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace popvcf
+{
+//! Splits a bgzipped popVCF into \a n_shards shards, or into shards of about \a target_size bytes if \a n_shards is 0,
+//! named \a prefix.<shard>.popvcf.gz. Shards are cut only where a block begins, so each is a valid popVCF, and each
+//! gets the header of the input and a tabix index. The cuts balance the decoding work of the shards, which is
+//! estimated from the encoded size and the number of samples of each record. Whole bgzf blocks are copied without
+//! inflating them. Writes the first and last record of each shard to standard output.
+void split_file(std::string const & popvcf_fn, std::string const & prefix, long n_shards, uint64_t const target_size);
+
+} // namespace popvcf
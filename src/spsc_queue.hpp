@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace popvcf
+{
+//! A bounded lock-free queue with exactly one producer thread and one consumer thread.
+template <typename T>
+class SpscQueue
+{
+public:
+  explicit SpscQueue(std::size_t const capacity)
+    : slots(capacity + 1) // one slot is always empty to tell a full queue from an empty one
+  {
+  }
+
+  //! Moves \a value into the queue. Returns false, leaving \a value as it was, if the queue is full.
+  bool try_push(T & value)
+  {
+    std::size_t const t = tail.load(std::memory_order_relaxed);
+    std::size_t const next = t + 1 == slots.size() ? 0 : t + 1;
+
+    if (next == head.load(std::memory_order_acquire))
+      return false;
+
+    slots[t] = std::move(value);
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  //! Moves the front of the queue into \a value. Returns false if the queue is empty.
+  bool try_pop(T & value)
+  {
+    std::size_t const h = head.load(std::memory_order_relaxed);
+
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+
+    value = std::move(slots[h]);
+    head.store(h + 1 == slots.size() ? 0 : h + 1, std::memory_order_release);
+    return true;
+  }
+
+  //! Moves \a value into the queue, waiting while it is full.
+  void push(T & value)
+  {
+    for (long attempt{0}; !try_push(value); ++attempt)
+      wait(attempt);
+  }
+
+  //! Returns the front of the queue, waiting while it is empty.
+  T pop()
+  {
+    T value;
+
+    for (long attempt{0}; !try_pop(value); ++attempt)
+      wait(attempt);
+
+    return value;
+  }
+
+private:
+  std::vector<T> slots;
+  alignas(64) std::atomic<std::size_t> head{0}; //!< Next slot to pop, only written by the consumer
+  alignas(64) std::atomic<std::size_t> tail{0}; //!< Next slot to push, only written by the producer
+
+  //! Spins first since the other thread is usually quick, then backs off to not burn a core on stalled input.
+  static void wait(long const attempt)
+  {
+    if (attempt < 64)
+      return;
+    else if (attempt < 128)
+      std::this_thread::yield();
+    else
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+};
+
+} // namespace popvcf
@@ -0,0 +1,227 @@
+#include "stats.hpp"
+
+#include <algorithm>   // std::count, std::all_of
+#include <cstdint>     // uint32_t
+#include <cstdio>      // fwrite, snprintf
+#include <cstdlib>     // std::exit
+#include <fstream>     // std::ifstream
+#include <iostream>    // std::cerr
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+#include <parallel_hashmap/phmap.h> // phmap::flat_hash_map
+
+#include "genotype.hpp"
+#include "reader.hpp"
+
+namespace popvcf
+{
+namespace
+{
+//! Returns the indices of the samples listed in \a samples_fn, one per line.
+std::vector<uint32_t> read_sample_indices(std::string const & samples_fn, std::vector<std::string> const & names)
+{
+  phmap::flat_hash_map<std::string, uint32_t> name2index;
+
+  for (uint32_t s{0}; s < names.size(); ++s)
+    name2index[names[s]] = s;
+
+  std::ifstream samples_file(samples_fn);
+
+  if (!samples_file.is_open())
+  {
+    std::cerr << "[popvcf] ERROR: Could not open samples file " << samples_fn << std::endl;
+    std::exit(1);
+  }
+
+  std::vector<uint32_t> indices;
+  std::string name;
+
+  while (std::getline(samples_file, name))
+  {
+    if (name.empty())
+      continue;
+
+    auto find_it = name2index.find(name);
+
+    if (find_it == name2index.end())
+    {
+      std::cerr << "[popvcf] ERROR: Sample " << name << " is not in the popVCF." << std::endl;
+      std::exit(1);
+    }
+
+    indices.push_back(find_it->second);
+  }
+
+  return indices;
+}
+
+void append_double(std::string & line, double const value)
+{
+  char buffer[32];
+  int const n = snprintf(buffer, sizeof(buffer), "%.6g", value);
+  line.append(buffer, n);
+}
+
+} // namespace
+
+void stats_file(std::string const & popvcf_fn, bool const allele_frequencies, std::string const & samples_fn)
+{
+  RecordReader reader(popvcf_fn);
+  std::vector<std::string> const sample_names = reader.get_sample_names();
+  std::vector<uint32_t> sample_indices; // counted samples, all if empty
+
+  if (!samples_fn.empty())
+    sample_indices = read_sample_indices(samples_fn, sample_names);
+
+  std::vector<uint32_t> counts; // number of counted samples with each unique genotype field
+  std::vector<int32_t> alleles; // alleles of a unique genotype field
+  std::vector<uint64_t> ac;     // allele count of each ALT allele
+  std::string line;             // output line
+  uint64_t n_records{0};
+  uint64_t n_genotype_fields{0};
+  uint64_t n_unique_fields{0};
+
+  if (allele_frequencies)
+  {
+    line = "#CHROM\tPOS\tID\tREF\tALT\tN_HOM_REF\tN_HET\tN_HOM_ALT\tN_MISSING\tAC\tAN\tAF\tF_MISSING\n";
+    fwrite(line.data(), 1, line.size(), stdout);
+  }
+
+  while (reader.next())
+  {
+    DecodeData const & dd = reader.dd;
+    ++n_records;
+    n_genotype_fields += dd.field2uid.size();
+    n_unique_fields += dd.unique_fields.size();
+
+    if (!allele_frequencies)
+      continue;
+
+    /// Count how many samples have each unique genotype field
+    counts.assign(dd.unique_fields.size(), 0);
+
+    if (sample_indices.empty())
+    {
+      for (uint32_t const uid : dd.field2uid)
+        ++counts[uid];
+    }
+    else
+    {
+      for (uint32_t const s : sample_indices)
+        ++counts[dd.field2uid[s]];
+    }
+
+    /// Parse each unique genotype field once and weight it by its count
+    std::string_view const alt = reader.get_site_column(4);
+    std::string_view const format = reader.get_site_column(8);
+    bool const has_gt = format.substr(0, 2) == "GT" && (format.size() == 2 || format[2] == ':');
+    ac.assign(alt == "." ? 0 : std::count(alt.begin(), alt.end(), ',') + 1, 0);
+    uint64_t n_hom_ref{0};
+    uint64_t n_het{0};
+    uint64_t n_hom_alt{0};
+    uint64_t n_missing{0};
+    uint64_t an{0};
+
+    for (uint32_t uid{0}; uid < counts.size(); ++uid)
+    {
+      uint32_t const count = counts[uid];
+
+      if (count == 0)
+        continue;
+
+      if (has_gt)
+        parse_gt(dd.unique_fields[uid], alleles);
+      else
+        alleles.resize(0);
+
+      bool is_missing = alleles.empty();
+
+      for (int32_t const allele : alleles)
+      {
+        if (allele == MISSING_ALLELE)
+        {
+          is_missing = true;
+          continue;
+        }
+
+        an += count;
+
+        if (allele > 0)
+        {
+          if (allele > static_cast<int32_t>(ac.size()))
+            ac.resize(allele, 0);
+
+          ac[allele - 1] += count;
+        }
+      }
+
+      if (is_missing)
+        n_missing += count;
+      else if (std::all_of(alleles.begin(), alleles.end(), [](int32_t a) { return a == 0; }))
+        n_hom_ref += count;
+      else if (std::all_of(alleles.begin(), alleles.end(), [&](int32_t a) { return a == alleles[0]; }))
+        n_hom_alt += count;
+      else
+        n_het += count;
+    }
+
+    /// Write the record
+    line.resize(0);
+
+    for (long c{0}; c < 5; ++c)
+    {
+      line.append(reader.get_site_column(c));
+      line.push_back('\t');
+    }
+
+    uint64_t const n_samples = sample_indices.empty() ? dd.field2uid.size() : sample_indices.size();
+
+    for (uint64_t const n : {n_hom_ref, n_het, n_hom_alt, n_missing})
+    {
+      line.append(std::to_string(n));
+      line.push_back('\t');
+    }
+
+    for (std::size_t a{0}; a < ac.size(); ++a)
+    {
+      line.append(a == 0 ? "" : ",");
+      line.append(std::to_string(ac[a]));
+    }
+
+    line.append(ac.empty() ? ".\t" : "\t");
+    line.append(std::to_string(an));
+    line.push_back('\t');
+
+    for (std::size_t a{0}; a < ac.size(); ++a)
+    {
+      line.append(a == 0 ? "" : ",");
+
+      if (an == 0)
+        line.push_back('.');
+      else
+        append_double(line, static_cast<double>(ac[a]) / an);
+    }
+
+    line.append(ac.empty() ? ".\t" : "\t");
+
+    if (n_samples == 0)
+      line.push_back('.');
+    else
+      append_double(line, static_cast<double>(n_missing) / n_samples);
+
+    line.push_back('\n');
+    fwrite(line.data(), 1, line.size(), stdout);
+  }
+
+  if (!allele_frequencies)
+  {
+    line = "samples\t" + std::to_string(sample_names.size()) + "\nrecords\t" + std::to_string(n_records) +
+           "\ngenotype fields\t" + std::to_string(n_genotype_fields) + "\nunique genotype fields\t" +
+           std::to_string(n_unique_fields) + "\n";
+    fwrite(line.data(), 1, line.size(), stdout);
+  }
+}
+
+} // namespace popvcf
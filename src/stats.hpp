@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+namespace popvcf
+{
+//! Writes a summary of a popVCF, or with \a allele_frequencies the genotype counts and allele frequencies of each
+//! record. Genotypes are counted in their deduplicated form, so each unique genotype field is parsed once per record.
+//! If \a samples_fn is not empty, only the samples listed in it are counted.
+void stats_file(std::string const & popvcf_fn, bool const allele_frequencies, std::string const & samples_fn);
+
+} // namespace popvcf
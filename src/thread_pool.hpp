@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace popvcf
+{
+//! A fixed number of worker threads. Tasks are started in the order they are submitted.
+class ThreadPool
+{
+public:
+  explicit ThreadPool(long const n_threads)
+  {
+    for (long t{0}; t < n_threads; ++t)
+      workers.emplace_back([this] { work(); });
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      is_stopped = true;
+    }
+
+    cv.notify_all();
+
+    for (std::thread & worker : workers)
+      worker.join();
+  }
+
+  ThreadPool(ThreadPool const &) = delete;
+  ThreadPool & operator=(ThreadPool const &) = delete;
+
+  //! Submits a task. Its result, or its exception, is available from the returned future.
+  template <typename Tfunc>
+  std::future<std::invoke_result_t<Tfunc>> submit(Tfunc && func)
+  {
+    using Tresult = std::invoke_result_t<Tfunc>;
+    auto task = std::make_shared<std::packaged_task<Tresult()>>(std::forward<Tfunc>(func));
+    std::future<Tresult> result = task->get_future();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.emplace([task] { (*task)(); });
+    }
+
+    cv.notify_one();
+    return result;
+  }
+
+private:
+  std::vector<std::thread> workers{};
+  std::queue<std::function<void()>> tasks{};
+  std::mutex mutex{};
+  std::condition_variable cv{};
+  bool is_stopped{false};
+
+  void work()
+  {
+    while (true)
+    {
+      std::function<void()> task;
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return is_stopped || !tasks.empty(); });
+
+        if (tasks.empty())
+          return; // stopped and no tasks left
+
+        task = std::move(tasks.front());
+        tasks.pop();
+      }
+
+      task();
+    }
+  }
+};
+
+} // namespace popvcf
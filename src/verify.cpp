@@ -0,0 +1,199 @@
+#include "verify.hpp"
+
+#include <algorithm>   // std::find, std::max
+#include <cstdint>     // uint32_t
+#include <deque>       // std::deque
+#include <future>      // std::future
+#include <iostream>    // std::cerr
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+#include <zlib.h>      // crc32
+
+#include "decode.hpp"
+#include "format.hpp"
+#include "io.hpp"
+#include "sequence_utils.hpp" // get_vcf_pos, is_same_block
+#include "thread_pool.hpp"
+
+#include "htslib/bgzf.h"
+#include "htslib/kstring.h"
+
+namespace popvcf
+{
+namespace
+{
+std::size_t constexpr TASK_SIZE{4 * DEC_BUFFER_SIZE}; //!< Blocks are verified in tasks of about this many bytes
+
+//! Encoded blocks verified by one task
+class VerifyTask
+{
+public:
+  std::vector<char> data{};              //!< Encoded records of the blocks
+  std::vector<std::size_t> block_ends{}; //!< End of each block in data
+};
+
+//! Outcome of a verify task
+class VerifyResult
+{
+public:
+  long n_records{0};
+  long n_checksums{0};
+  std::vector<std::string> errors{};
+};
+
+VerifyResult verify_blocks(VerifyTask const & task, FormatOptions const & options)
+{
+  VerifyResult result;
+  std::vector<char> line;    // encoded record
+  std::vector<char> decoded; // decoded record
+  std::size_t b{0};
+
+  for (std::size_t const block_end : task.block_ends)
+  {
+    /// Each block is decoded from scratch, records never refer to records of other blocks
+    DecodeData dd;
+    dd.options = options;
+    uint32_t checksum{0};
+
+    while (b < block_end)
+    {
+      std::size_t const e = std::find(task.data.begin() + b, task.data.begin() + block_end, '\n') - task.data.begin();
+      line.assign(task.data.begin() + b, task.data.begin() + e + 1);
+      decoded.resize(0);
+      decode_buffer</*is_region=*/false>(decoded, line, dd);
+      Bytef const * const decoded_data = reinterpret_cast<Bytef const *>(decoded.data());
+      checksum = crc32(checksum, decoded_data, decoded.size());
+      ++result.n_records;
+
+      if (dd.has_checksum)
+      {
+        ++result.n_checksums;
+        dd.has_checksum = false;
+
+        /// Files concatenated in the middle of a block have checksums that start over at the first record
+        if (dd.checksum != checksum && dd.checksum == crc32(0, decoded_data, decoded.size()))
+          checksum = dd.checksum;
+
+        if (dd.checksum != checksum)
+        {
+          std::string_view const record(decoded.data(), decoded.size());
+          std::size_t const pos_end = record.find('\t', record.find('\t') + 1);
+          std::string location(record.substr(0, pos_end));
+          location[location.find('\t')] = ':';
+          result.errors.push_back("Checksum mismatch in the record at " + location);
+          b = block_end; // later records of the block would also mismatch
+          break;
+        }
+      }
+
+      b = e + 1;
+    }
+  }
+
+  return result;
+}
+
+} // namespace
+
+long verify_file(std::string const & popvcf_fn, int const threads)
+{
+  popvcf::bgzf_ptr in_bgzf = popvcf::open_bgzf(popvcf_fn, "r");
+
+  if (threads > 1)
+    bgzf_mt(in_bgzf.get(), threads, 256);
+
+  FormatOptions options;
+  ThreadPool pool(std::max(1, threads));
+  std::deque<std::future<VerifyResult>> results;
+  std::size_t const max_pending_tasks = 4 * std::max(1, threads);
+  VerifyTask task;
+  std::string block_contig; // empty before the first record
+  long block_pos{0};         // POS of the first record of the block
+  long n_blocks{0};
+  long n_records{0};
+  long n_checksums{0};
+  long n_errors{0};
+
+  auto collect_result = [&]()
+  {
+    VerifyResult const result = results.front().get();
+    results.pop_front();
+    n_records += result.n_records;
+    n_checksums += result.n_checksums;
+
+    for (std::string const & error : result.errors)
+    {
+      std::cerr << "[popvcf] ERROR: " << error << std::endl;
+      ++n_errors;
+    }
+  };
+
+  auto submit_task = [&]()
+  {
+    if (task.data.empty())
+      return;
+
+    task.block_ends.push_back(task.data.size());
+    results.push_back(pool.submit([t = std::move(task), &options]() { return verify_blocks(t, options); }));
+    task = VerifyTask();
+
+    if (results.size() >= max_pending_tasks)
+      collect_result();
+  };
+
+  kstring_t str = {0, 0, nullptr};
+  int ret{0};
+
+  while ((ret = bgzf_getline(in_bgzf.get(), '\n', &str)) >= 0)
+  {
+    if (str.l > 0 && str.s[0] == '#')
+    {
+      options.parse_header_line(std::string_view(str.s, str.l));
+      continue;
+    }
+
+    /// Find where blocks begin, the same way the encoder does
+    std::string_view const contig(str.s, std::find(str.s, str.s + str.l, '\t') - str.s);
+    long const pos = get_vcf_pos(str.s, str.s + str.l);
+
+    if (!is_same_block(contig, pos, block_contig, block_pos))
+    {
+      if (task.data.size() >= TASK_SIZE)
+        submit_task();
+      else if (!task.data.empty())
+        task.block_ends.push_back(task.data.size());
+
+      block_contig.assign(contig);
+      block_pos = pos;
+      ++n_blocks;
+    }
+
+    task.data.insert(task.data.end(), str.s, str.s + str.l);
+    task.data.push_back('\n');
+  }
+
+  free(str.s);
+  submit_task();
+
+  while (!results.empty())
+    collect_result();
+
+  if (ret < -1)
+  {
+    std::cerr << "[popvcf] ERROR: Failed reading " << popvcf_fn << std::endl;
+    ++n_errors;
+  }
+
+  if (!options.checksum)
+  {
+    std::cerr << "[popvcf] WARNING: " << popvcf_fn << " was encoded without checksums, only checked that it can be "
+              << "read and decoded." << std::endl;
+  }
+
+  std::cerr << "[popvcf] Verified " << n_records << " records in " << n_blocks << " blocks with " << n_checksums
+            << " checksums and found " << n_errors << (n_errors == 1 ? " error." : " errors.") << std::endl;
+  return n_errors;
+}
+
+} // namespace popvcf
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+namespace popvcf
+{
+//! Decodes every block of a popVCF, using \a threads threads, and compares the decoded records with the checksums
+//! stored in the file. Nothing is written except a summary. Returns the number of errors found.
+long verify_file(std::string const & popvcf_fn, int const threads);
+
+} // namespace popvcf
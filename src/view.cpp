@@ -0,0 +1,143 @@
+#include "view.hpp"
+
+#include <iostream>  // std::cerr
+#include <limits>    // std::numeric_limits
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+#include "decode.hpp"
+#include "encode.hpp"
+#include "format.hpp"
+#include "io.hpp"
+#include "sequence_utils.hpp" // parse_region, get_block_region, get_vcf_pos
+
+#include "htslib/bgzf.h"
+#include "htslib/hts.h"
+#include "htslib/kseq.h"
+#include "htslib/tbx.h"
+
+namespace popvcf
+{
+void view_region(std::string const & popvcf_fn,
+                 std::string const & region,
+                 std::string const & output_fn,
+                 std::string const & output_mode,
+                 bool const is_bgzf_output,
+                 int const compression_threads,
+                 bool const write_index)
+{
+  if (write_index && (!is_bgzf_output || output_fn == "-"))
+  {
+    std::cerr << "[popvcf] ERROR: Writing an index requires a bgzipped output file." << std::endl;
+    std::exit(1);
+  }
+
+  /// parse region
+  std::string chrom;
+  long begin{-1};
+  long end{std::numeric_limits<long>::max()};
+  parse_region(region, chrom, begin, end);
+
+  /// Records of the block containing the region begin are needed as context even if they are outside the region
+  long safe_begin{0};
+  std::string const safe_region = get_block_region(chrom, begin, end, safe_begin);
+
+  /// Input streams
+  popvcf::hts_file_ptr in_bgzf = popvcf::open_hts_file(popvcf_fn.c_str(), "r");            // open popvcf.gz
+  popvcf::tbx_t_ptr in_tbx = popvcf::open_tbx_t(popvcf_fn.c_str());                        // open popvcf.gz.tbi
+  popvcf::hts_itr_t_ptr in_it = popvcf::open_hts_itr_t(in_tbx.get(), safe_region.c_str()); // query region
+
+  {
+    /// Open output file streams
+    popvcf::bgzf_ptr out_bgzf(nullptr, popvcf::close_bgzf);   // bgzf output stream
+    popvcf::file_ptr out_vcf(nullptr, popvcf::close_vcf_nop); // popvcf output stream
+
+    if (is_bgzf_output)
+    {
+      out_bgzf = popvcf::open_bgzf(output_fn, output_mode);
+
+      if (compression_threads > 1)
+        bgzf_mt(out_bgzf.get(), compression_threads, 256);
+    }
+    else
+    {
+      out_vcf = popvcf::open_vcf(output_fn, output_mode);
+    }
+
+    /// Write the header lines as they are
+    kstring_t str = {0, 0, 0};
+    FormatOptions options;
+
+    while (hts_getline(in_bgzf.get(), KS_SEP_LINE, &str) >= 0)
+    {
+      if (!str.l || str.s[0] != in_tbx->conf.meta_char)
+        break;
+
+      options.parse_header_line(std::string_view(str.s, str.l));
+      str.s[str.l] = '\n';
+      popvcf::write_output(out_bgzf.get(), out_vcf.get(), str.s, str.l + 1);
+    }
+
+    if (in_it != nullptr)
+    {
+      std::vector<char> buffer_in;  // encoded records of the first block that need to be decoded
+      std::vector<char> decoded;    // decoded records inside the region of the first block
+      std::vector<char> buffer_out; // re-encoded records of the first block
+      DecodeData dd;
+      EncodeData ed;
+      dd.begin = begin;
+      dd.end = end;
+      dd.options = options;
+      ed.set_options(options);
+      ed.is_options_written = true; // it was copied with the rest of the header
+      long const first_block = begin >= 0 ? begin / BLOCK_SIZE : -1;
+      bool is_first_block_decoded{false}; // true if the first block has records before the region begin
+
+      int ret = tbx_itr_next(in_bgzf.get(), in_tbx.get(), in_it.get(), &str);
+
+      while (ret > 0)
+      {
+        long const vcf_pos = get_vcf_pos(str.s, str.s + str.l);
+
+        if (vcf_pos > end)
+          break;
+
+        if (vcf_pos >= safe_begin)
+        {
+          bool const is_first_block = (vcf_pos / BLOCK_SIZE) == first_block;
+          is_first_block_decoded = is_first_block_decoded || (is_first_block && vcf_pos < begin);
+
+          if (is_first_block && is_first_block_decoded)
+          {
+            /// Records in the first block may refer to records before the region begin, decode and encode them again
+            buffer_in.insert(buffer_in.end(), str.s, str.s + str.l);
+            buffer_in.push_back('\n');
+            decode_buffer</*is_region=*/true>(decoded, buffer_in, dd);
+            encode_buffer(buffer_out, decoded, ed);
+            popvcf::write_output(out_bgzf.get(), out_vcf.get(), buffer_out.data(), buffer_out.size());
+            buffer_out.resize(0);
+          }
+          else
+          {
+            /// Whole blocks inside the region, and the start of the block with the region end, are copied as they are
+            str.s[str.l] = '\n';
+            popvcf::write_output(out_bgzf.get(), out_vcf.get(), str.s, str.l + 1);
+          }
+        }
+
+        ret = tbx_itr_next(in_bgzf.get(), in_tbx.get(), in_it.get(), &str);
+      }
+    }
+
+    free(str.s);
+  } // closes the output file
+
+  if (write_index && tbx_index_build(output_fn.c_str(), 0, &tbx_conf_vcf) != 0)
+  {
+    std::cerr << "[popvcf] ERROR: Failed building a tabix index for " << output_fn << std::endl;
+    std::exit(1);
+  }
+}
+
+} // namespace popvcf
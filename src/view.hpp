@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+namespace popvcf
+{
+//! Write a region of a bgzipped and tabix indexed popVCF as a new popVCF, without decoding whole blocks.
+void view_region(std::string const & popvcf_fn,
+                 std::string const & region,
+                 std::string const & output_fn,
+                 std::string const & output_mode,
+                 bool const is_bgzf_output,
+                 int const compression_threads,
+                 bool const write_index);
+
+} // namespace popvcf
@@ -0,0 +1,159 @@
+#include "zone_map.hpp"
+
+#include <algorithm>   // std::count_if, std::min, std::max
+#include <charconv>    // std::from_chars
+#include <cstdlib>     // std::exit
+#include <fstream>     // std::ifstream, std::ofstream
+#include <iostream>    // std::cerr
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+#include "genotype.hpp"
+#include "io.hpp"             // get_file_mtime, get_file_size
+#include "sequence_utils.hpp" // is_same_block, split_string
+
+namespace popvcf
+{
+namespace
+{
+//! Parses an integer column of a zone map line.
+template <typename T>
+bool parse_column(std::string_view const column, T & value)
+{
+  auto ret = std::from_chars(column.data(), column.data() + column.size(), value);
+  return ret.ec == std::errc() && ret.ptr == column.data() + column.size();
+}
+
+} // namespace
+
+void ZoneMap::add_record(std::string const & contig,
+                         int64_t const pos,
+                         int32_t const n_alt,
+                         bool const has_gt,
+                         std::vector<std::string> const & unique_fields,
+                         std::vector<uint32_t> const & field2uid,
+                         uint64_t const offset)
+{
+  /// Count the non-reference alleles of each unique field once
+  uint64_t ac{0};
+
+  if (has_gt)
+  {
+    uid_counts.assign(unique_fields.size(), 0);
+
+    for (uint32_t const uid : field2uid)
+      ++uid_counts[uid];
+
+    for (std::size_t uid{0}; uid < unique_fields.size(); ++uid)
+    {
+      parse_gt(unique_fields[uid], alleles);
+      ac += uid_counts[uid] * std::count_if(alleles.begin(), alleles.end(), [](int32_t a) { return a > 0; });
+    }
+  }
+
+  uint32_t const flags = (ac > 0 ? ZONE_NON_REF : 0) | (n_alt > 0 ? ZONE_MULTI_ALLELIC : 0);
+
+  if (zones.empty() || !is_same_block(zones.back().contig, zones.back().pos_min, contig, pos))
+  {
+    Zone zone;
+    zone.contig = contig;
+    zone.pos_min = pos;
+    zone.pos_max = pos;
+    zone.n_records = 1;
+    zone.offset = offset;
+    zone.ac_min = ac;
+    zone.ac_max = ac;
+    zone.flags = flags;
+    zones.push_back(std::move(zone));
+    return;
+  }
+
+  Zone & zone = zones.back();
+  zone.pos_min = std::min(zone.pos_min, pos);
+  zone.pos_max = std::max(zone.pos_max, pos);
+  ++zone.n_records;
+  zone.ac_min = std::min(zone.ac_min, ac);
+  zone.ac_max = std::max(zone.ac_max, ac);
+  zone.flags |= flags;
+}
+
+void ZoneMap::write(std::string const & fn) const
+{
+  std::ofstream out(fn);
+
+  if (!out.is_open())
+  {
+    std::cerr << "[popvcf] ERROR: Could not open zone map " << fn << " for writing." << std::endl;
+    std::exit(1);
+  }
+
+  out << "##popvcf_zone_map=1\n"
+      << "##file_size=" << file_size << '\n'
+      << "##file_mtime=" << file_mtime << '\n'
+      << "##FLAGS: 1 some genotype has a non-reference allele, 2 some record has several ALT alleles\n"
+      << "#CHROM\tPOS_MIN\tPOS_MAX\tN_RECORDS\tOFFSET\tAC_MIN\tAC_MAX\tFLAGS\n";
+
+  for (Zone const & zone : zones)
+  {
+    out << zone.contig << '\t' << zone.pos_min << '\t' << zone.pos_max << '\t' << zone.n_records << '\t'
+        << zone.offset << '\t' << zone.ac_min << '\t' << zone.ac_max << '\t' << zone.flags << '\n';
+  }
+}
+
+bool ZoneMap::read(std::string const & fn)
+{
+  std::ifstream in(fn);
+
+  if (!in.is_open())
+    return false;
+
+  zones.clear();
+  std::string line;
+  std::string_view constexpr FILE_SIZE_PREFIX{"##file_size="};
+  std::string_view constexpr FILE_MTIME_PREFIX{"##file_mtime="};
+
+  while (std::getline(in, line))
+  {
+    std::string_view const line_view(line);
+    bool is_valid{true};
+
+    if (line_view.substr(0, FILE_SIZE_PREFIX.size()) == FILE_SIZE_PREFIX)
+      is_valid = parse_column(line_view.substr(FILE_SIZE_PREFIX.size()), file_size);
+    else if (line_view.substr(0, FILE_MTIME_PREFIX.size()) == FILE_MTIME_PREFIX)
+      is_valid = parse_column(line_view.substr(FILE_MTIME_PREFIX.size()), file_mtime);
+
+    if (!is_valid)
+    {
+      std::cerr << "[popvcf] ERROR: Could not parse line of zone map " << fn << ": " << line << std::endl;
+      std::exit(1);
+    }
+
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::vector<std::string_view> const columns = split_string(line, '\t');
+    Zone zone;
+
+    if (columns.size() != 8 || !parse_column(columns[1], zone.pos_min) || !parse_column(columns[2], zone.pos_max) ||
+        !parse_column(columns[3], zone.n_records) || !parse_column(columns[4], zone.offset) ||
+        !parse_column(columns[5], zone.ac_min) || !parse_column(columns[6], zone.ac_max) ||
+        !parse_column(columns[7], zone.flags))
+    {
+      std::cerr << "[popvcf] ERROR: Could not parse line of zone map " << fn << ": " << line << std::endl;
+      std::exit(1);
+    }
+
+    zone.contig = columns[0];
+    zones.push_back(std::move(zone));
+  }
+
+  return true;
+}
+
+bool ZoneMap::is_stale(std::string const & popvcf_fn) const
+{
+  return get_file_size(popvcf_fn) != file_size || get_file_mtime(popvcf_fn) != file_mtime;
+}
+
+} // namespace popvcf
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace popvcf
+{
+char constexpr ZONE_MAP_SUFFIX[]{".pzm"}; //!< Suffix of the zone map of a popVCF
+
+uint32_t constexpr ZONE_NON_REF{1};       //!< Some genotype of the block has a non-reference allele
+uint32_t constexpr ZONE_MULTI_ALLELIC{2}; //!< Some record of the block has several ALT alleles
+
+//! Summary of the records of one block
+class Zone
+{
+public:
+  std::string contig{};
+  int64_t pos_min{0};
+  int64_t pos_max{0};
+  uint64_t n_records{0};
+  uint64_t offset{0}; //!< Offset of the first record of the block in the uncompressed popVCF
+  uint64_t ac_min{0}; //!< Lowest number of non-reference alleles in GT of a record
+  uint64_t ac_max{0}; //!< Highest number of non-reference alleles in GT of a record
+  uint32_t flags{0};  //!< ZONE_NON_REF and ZONE_MULTI_ALLELIC
+};
+
+//! Zone map of a popVCF, a sidecar file with a summary of each block. Readers use it to skip blocks that cannot have
+//! records they are looking for, the offsets of the blocks are found in the bgzipped popVCF with its .gzi index.
+class ZoneMap
+{
+public:
+  uint64_t file_size{0}; //!< Size of the popVCF when the zone map was written, a different size means it changed
+  int64_t file_mtime{0}; //!< Modification time of the popVCF when the zone map was written, in seconds
+  std::vector<Zone> zones{};
+
+  //! Adds a record that begins at \a offset in the uncompressed popVCF. If \a has_gt is false, the genotype fields
+  //! have no GT subfield and the record counts as having no non-reference alleles.
+  void add_record(std::string const & contig,
+                  int64_t const pos,
+                  int32_t const n_alt,
+                  bool const has_gt,
+                  std::vector<std::string> const & unique_fields,
+                  std::vector<uint32_t> const & field2uid,
+                  uint64_t const offset);
+
+  //! Writes the zone map to \a fn.
+  void write(std::string const & fn) const;
+
+  //! Reads the zone map in \a fn. Returns false if the file does not exist, exits if it cannot be parsed.
+  bool read(std::string const & fn);
+
+  //! Returns true iff \a popvcf_fn has another size or modification time than when the zone map was written.
+  bool is_stale(std::string const & popvcf_fn) const;
+
+private:
+  std::vector<uint64_t> uid_counts{}; //!< Number of samples with each unique field of the record
+  std::vector<int32_t> alleles{};     //!< Alleles of the GT that is counted
+};
+
+} // namespace popvcf
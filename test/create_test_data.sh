@@ -7,7 +7,7 @@ echo "##contig=<ID=chr2>"
 echo "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype.\">"
 echo "##FORMAT=<ID=AD,Number=R,Type=Integer,Description=\"Allelic depths.\">"
 echo "##FORMAT=<ID=PL,Number=G,Type=Integer,Description=\"PHRED-scaled genotype likelihoods.\">"
-echo -e -n "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT"
+printf "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT"
 
 awk -v n=${n} 'BEGIN{
   for (i = 1; i <= n; i++){